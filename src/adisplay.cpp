@@ -0,0 +1,285 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "adisplay.h"
+#include "stats.h"
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cwchar>
+#include <clocale>
+#include <cstdio>
+#include <climits>
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+	// attributes are a bitmask of
+	// (1 << vbrush::iface::attr)
+	typedef uint16_t	attr_mask;
+
+	const attr_mask	COLOR_MASK = (1 << vbrush::iface::C_BLUE) | (1 << vbrush::iface::C_MAGENTA) | (1 << vbrush::iface::C_YELLOW) | (1 << vbrush::iface::C_GREEN);
+
+	struct cell {
+		wchar_t		ch;
+		attr_mask	attr;
+
+		bool operator==(const cell& rhs) const {
+			return (ch == rhs.ch) && (attr == rhs.attr);
+		}
+
+		bool operator!=(const cell& rhs) const {
+			return !(*this == rhs);
+		}
+	};
+
+	// placeholder for the 2nd column
+	// of a wide character
+	const wchar_t	WIDE_CONT = 0;
+
+	const cell	EMPTY_CELL = { L' ', 0 };
+
+	class aimpl : public vbrush::iface {
+		int			rows_,
+					cols_,
+					cur_row_,
+					cur_col_;
+		attr_mask		cur_attr_;
+		// back_ is what we're drawing, front_
+		// is what the terminal is displaying
+		std::vector<cell>	front_,
+					back_;
+		// rows left as they are
+		std::vector<char>	kept_;
+		bool			full_redraw_;
+		std::string		out_;
+		struct termios		orig_tio_;
+		bool			tio_set_;
+		// stats
+		size_t			frames_,
+					total_bytes_,
+					last_bytes_;
+
+		void put(const wchar_t c) {
+			if(cur_row_ >= rows_ || cur_col_ >= cols_)
+				return;
+			const int	w = wcwidth(c);
+			if(w <= 0)
+				return;
+			if(w == 2 && cur_col_ + 1 >= cols_)
+				return;
+			back_[cur_row_*cols_ + cur_col_] = cell{ c, cur_attr_ };
+			if(w == 2)
+				back_[cur_row_*cols_ + cur_col_ + 1] = cell{ WIDE_CONT, cur_attr_ };
+			cur_col_ += w;
+		}
+
+		void append_utf8(const wchar_t c) {
+			char		buf[MB_LEN_MAX];
+			mbstate_t	mbs = mbstate_t();
+			const size_t	rv = wcrtomb(buf, c, &mbs);
+			if(rv == (size_t)-1)
+				out_ += '?';
+			else
+				out_.append(buf, rv);
+		}
+
+		void append_sgr(const attr_mask a) {
+			out_ += "\x1b[0";
+			if(a & (1 << BOLD)) out_ += ";1";
+			if(a & (1 << DIM)) out_ += ";2";
+			if(a & (1 << REVERSE)) out_ += ";7";
+			if(a & (1 << C_BLUE)) out_ += ";34";
+			else if(a & (1 << C_MAGENTA)) out_ += ";35";
+			else if(a & (1 << C_YELLOW)) out_ += ";33";
+			else if(a & (1 << C_GREEN)) out_ += ";32";
+			out_ += 'm';
+		}
+
+		void append_move(const int r, const int c) {
+			char	buf[32];
+			std::snprintf(buf, sizeof(buf), "\x1b[%d;%dH", r+1, c+1);
+			out_ += buf;
+		}
+
+		void flush(void) {
+			size_t	done = 0;
+			while(done < out_.size()) {
+				const ssize_t	rv = write(STDOUT_FILENO, out_.data() + done, out_.size() - done);
+				if(rv <= 0) {
+					if(rv < 0 && errno == EINTR)
+						continue;
+					throw std::runtime_error("Can't write to terminal");
+				}
+				done += rv;
+			}
+			last_bytes_ = out_.size();
+			total_bytes_ += out_.size();
+			stats::add(stats::TERM_BYTES, out_.size());
+			out_.clear();
+		}
+	public:
+		aimpl() : rows_(0), cols_(0), cur_row_(0), cur_col_(0), cur_attr_(0), full_redraw_(true), orig_tio_(), tio_set_(false), frames_(0), total_bytes_(0), last_bytes_(0) {
+			// this is needed to convert
+			// wchar_t to UTF-8
+			setlocale(LC_CTYPE, "");
+			// get keys without waiting for
+			// a new line and don't echo those
+			if(isatty(STDIN_FILENO) && !tcgetattr(STDIN_FILENO, &orig_tio_)) {
+				struct termios	tio = orig_tio_;
+				tio.c_lflag &= ~(ICANON|ECHO);
+				tio.c_cc[VMIN] = 1;
+				tio.c_cc[VTIME] = 0;
+				tio_set_ = !tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+			}
+			// alternate screen and hide cursor
+			out_ = "\x1b[?1049h\x1b[?25l";
+			flush();
+		}
+
+		~aimpl() {
+			out_ = "\x1b[0m\x1b[?25h\x1b[?1049l";
+			try {
+				flush();
+			} catch(...) {
+			}
+			if(tio_set_)
+				tcsetattr(STDIN_FILENO, TCSANOW, &orig_tio_);
+			if(frames_)
+				std::cerr << "ANSI display: " << frames_ << " frames, " << total_bytes_/frames_ << " bytes/frame on average" << std::endl;
+		}
+
+		virtual bool init(void) {
+			struct winsize	ws = {0};
+			if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) || !ws.ws_row || !ws.ws_col) {
+				ws.ws_row = 24;
+				ws.ws_col = 80;
+			}
+			// on resize the terminal content
+			// is unknown, redraw everything
+			if(ws.ws_row != rows_ || ws.ws_col != cols_) {
+				rows_ = ws.ws_row;
+				cols_ = ws.ws_col;
+				front_.assign(rows_*cols_, EMPTY_CELL);
+				full_redraw_ = true;
+			}
+			back_.assign(rows_*cols_, EMPTY_CELL);
+			kept_.assign(rows_, 0);
+			cur_row_ = cur_col_ = 0;
+			cur_attr_ = 0;
+			if(cols_ < 64 || rows_ < 15) {
+				char	buf[64];
+				std::snprintf(buf, sizeof(buf), "\x1b[0m\x1b[2J\x1b[HNeed at least a screen of 64x15 (%d/%d)", cols_, rows_);
+				out_ = buf;
+				flush();
+				full_redraw_ = true;
+				return false;
+			}
+			return true;
+		}
+
+		virtual void draw_text(const char* t, const ssize_t len) {
+			const int	end_col = cur_col_ + ((len >= 0) ? len : std::strlen(t));
+			for(; *t; ++t)
+				put((wchar_t)(unsigned char)*t);
+			cur_col_ = end_col;
+		}
+
+		virtual void draw_text(const wchar_t* t, const ssize_t len) {
+			const int	end_col = cur_col_ + ((len >= 0) ? len : std::wcslen(t));
+			for(; *t; ++t)
+				put(*t);
+			cur_col_ = end_col;
+		}
+
+		virtual void next_row(const size_t n_rows) {
+			cur_row_ += n_rows;
+			cur_col_ = 0;
+		}
+
+		virtual void set_attr_on(const vbrush::iface::attr a) {
+			// only one color at a time
+			if((1 << a) & COLOR_MASK)
+				cur_attr_ &= ~COLOR_MASK;
+			cur_attr_ |= (1 << a);
+		}
+
+		virtual void set_attr_off(const vbrush::iface::attr a) {
+			cur_attr_ &= ~(1 << a);
+		}
+
+		virtual bool keep_row(void) {
+			if(full_redraw_ || cur_row_ >= rows_)
+				return false;
+			kept_[cur_row_] = 1;
+			return true;
+		}
+
+		virtual void display(void) {
+			if(full_redraw_) {
+				out_ += "\x1b[0m\x1b[2J";
+				front_.assign(rows_*cols_, EMPTY_CELL);
+				full_redraw_ = false;
+			}
+			// position and attributes of the
+			// terminal, -1 means unknown
+			int		t_row = -1,
+					t_col = -1;
+			attr_mask	t_attr = 0;
+			bool		t_attr_set = false;
+			for(int r = 0; r < rows_; ++r) {
+				if(kept_[r])
+					continue;
+				for(int c = 0; c < cols_; ++c) {
+					const cell&	b = back_[r*cols_ + c];
+					cell&		f = front_[r*cols_ + c];
+					if(b == f)
+						continue;
+					f = b;
+					if(b.ch == WIDE_CONT)
+						continue;
+					if(t_row != r || t_col != c)
+						append_move(r, c);
+					if(!t_attr_set || t_attr != b.attr) {
+						append_sgr(b.attr);
+						t_attr = b.attr;
+						t_attr_set = true;
+					}
+					append_utf8(b.ch);
+					t_row = r;
+					t_col = c + ((wcwidth(b.ch) == 2) ? 2 : 1);
+				}
+			}
+			++frames_;
+			// nothing changed, nothing to write
+			if(out_.empty()) {
+				last_bytes_ = 0;
+				return;
+			}
+			flush();
+		}
+	};
+}
+
+vbrush::iface* adisplay::get(void) {
+	return new aimpl;
+}
+
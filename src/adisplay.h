@@ -0,0 +1,32 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _ADISPLAY_H_
+#define _ADISPLAY_H_
+
+#include "vbrush.h"
+
+// Terminal display using raw ANSI escape sequences
+// instead of ncurses; it keeps the last displayed
+// frame and only emits what has changed
+
+namespace adisplay {
+	extern vbrush::iface* get(void);
+}
+
+#endif //_ADISPLAY_H_
+
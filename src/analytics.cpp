@@ -0,0 +1,130 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "analytics.h"
+#include <algorithm>
+
+const uint64_t	analytics::dps_tracker::BUCKET_MS;
+const size_t	analytics::dps_tracker::N_BUCKETS,
+		analytics::dps_tracker::SHORT_BUCKETS,
+		analytics::dps_tracker::LONG_BUCKETS;
+
+void analytics::dps_tracker::player::reset(void) {
+	active = false;
+	name.clear();
+	std::fill(&buckets[0], &buckets[N_BUCKETS], 0);
+	head_bucket = start_ms = last_ms = 0;
+	short_sum = long_sum = 0;
+	base_damage = last_damage = 0;
+	peak = 0.0;
+}
+
+void analytics::dps_tracker::player::start(const uint64_t ts_ms, const std::wstring& n, const int32_t damage) {
+	reset();
+	active = true;
+	name = n;
+	head_bucket = ts_ms/BUCKET_MS;
+	start_ms = last_ms = ts_ms;
+	// we may have been started mid hunt, hence
+	// only count damage from now on
+	base_damage = last_damage = damage;
+}
+
+void analytics::dps_tracker::player::advance(const uint64_t bucket) {
+	if(bucket <= head_bucket)
+		return;
+	// if we've been idle for longer than the
+	// long window, all buckets are stale
+	if(bucket - head_bucket >= LONG_BUCKETS) {
+		std::fill(&buckets[0], &buckets[N_BUCKETS], 0);
+		short_sum = long_sum = 0;
+		head_bucket = bucket;
+		return;
+	}
+	// this loop is bounded by LONG_BUCKETS
+	while(head_bucket < bucket) {
+		++head_bucket;
+		// buckets leaving the windows
+		short_sum -= buckets[(head_bucket - SHORT_BUCKETS) % N_BUCKETS];
+		long_sum -= buckets[(head_bucket - LONG_BUCKETS) % N_BUCKETS];
+		buckets[head_bucket % N_BUCKETS] = 0;
+	}
+}
+
+void analytics::dps_tracker::player::update(const uint64_t ts_ms, const int32_t damage) {
+	advance(ts_ms/BUCKET_MS);
+	const int32_t	delta = damage - last_damage;
+	buckets[head_bucket % N_BUCKETS] += delta;
+	short_sum += delta;
+	long_sum += delta;
+	last_damage = damage;
+	last_ms = ts_ms;
+	// only track peaks once the short
+	// window is full, or the first hits
+	// would look like huge bursts
+	const uint64_t	elapsed = last_ms - start_ms;
+	if(elapsed >= SHORT_BUCKETS*BUCKET_MS)
+		peak = std::max(peak, (float)(1000.0*short_sum/(SHORT_BUCKETS*BUCKET_MS)));
+}
+
+void analytics::dps_tracker::player::output(ui::mhw_data::player_info& p) const {
+	// at the beginning windows are
+	// only partially filled
+	const uint64_t	elapsed = std::max(last_ms - start_ms, BUCKET_MS),
+			short_ms = std::min(elapsed, SHORT_BUCKETS*BUCKET_MS),
+			long_ms = std::min(elapsed, LONG_BUCKETS*BUCKET_MS);
+	p.dps_short = 1000.0*short_sum/short_ms;
+	p.dps_long = 1000.0*long_sum/long_ms;
+	p.dps_hunt = 1000.0*(last_damage - base_damage)/elapsed;
+	p.dps_peak = peak;
+}
+
+analytics::dps_tracker::dps_tracker() {
+	reset();
+}
+
+void analytics::dps_tracker::update(const uint64_t ts_ms, ui::mhw_data& d) {
+	static_assert(sizeof(players_)/sizeof(players_[0]) == sizeof(d.players)/sizeof(d.players[0]), "Tracked players and ui::mhw_data players don't match");
+	for(size_t i = 0; i < sizeof(players_)/sizeof(players_[0]); ++i) {
+		auto&	p = players_[i];
+		auto&	dp = d.players[i];
+		if(!dp.used) {
+			p.reset();
+			continue;
+		}
+		// a player who left keeps its
+		// rates frozen at leave time
+		if(dp.left_session) {
+			if(p.active)
+				p.output(dp);
+			continue;
+		}
+		// new player in this slot, or damage
+		// went backwards (i.e. new hunt)
+		if(!p.active || (p.name != dp.name) || (dp.damage < p.last_damage))
+			p.start(ts_ms, dp.name, dp.damage);
+		else
+			p.update(ts_ms, dp.damage);
+		p.output(dp);
+	}
+}
+
+void analytics::dps_tracker::reset(void) {
+	for(auto& p : players_)
+		p.reset();
+}
+
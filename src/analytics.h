@@ -0,0 +1,77 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _ANALYTICS_H_
+#define _ANALYTICS_H_
+
+#include <string>
+#include <cstdint>
+#include "ui.h"
+
+namespace analytics {
+	// keeps rolling damage rates for all the players
+	// damage deltas are accumulated in fixed time buckets
+	// in a ring buffer, and the window sums are updated
+	// incrementally, hence each sample costs O(1)
+	// regardless of the length of the hunt
+	class dps_tracker {
+	public:
+		const static uint64_t	BUCKET_MS = 250;
+		const static size_t	N_BUCKETS = 128,
+		      			SHORT_BUCKETS = 5000/BUCKET_MS,
+					LONG_BUCKETS = 30000/BUCKET_MS;
+
+		static_assert(LONG_BUCKETS < N_BUCKETS, "Ring buffer too small for the long window");
+	private:
+		struct player {
+			bool		active;
+			std::wstring	name;
+			int32_t		buckets[N_BUCKETS];
+			uint64_t	head_bucket,
+					start_ms,
+					last_ms;
+			int64_t		short_sum,
+					long_sum;
+			int32_t		base_damage,
+					last_damage;
+			float		peak;
+
+			void reset(void);
+
+			void start(const uint64_t ts_ms, const std::wstring& n, const int32_t damage);
+
+			void advance(const uint64_t bucket);
+
+			void update(const uint64_t ts_ms, const int32_t damage);
+
+			void output(ui::mhw_data::player_info& p) const;
+		};
+
+		player	players_[4];
+	public:
+		dps_tracker();
+
+		// feed a sample taken at ts_ms (monotonic)
+		// and write rolling rates back into d
+		void update(const uint64_t ts_ms, ui::mhw_data& d);
+
+		void reset(void);
+	};
+}
+
+#endif //_ANALYTICS_H_
+
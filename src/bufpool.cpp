@@ -0,0 +1,111 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "bufpool.h"
+#include "stats.h"
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+
+namespace {
+	const size_t	PAGE_SIZE = 4096,
+			HUGE_SIZE = 2*1024*1024;
+
+	uint8_t* map_buffer(const size_t cls) {
+		if(cls < HUGE_SIZE) {
+			void	*p = mmap(0, cls, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			return (MAP_FAILED == p) ? 0 : (uint8_t*)p;
+		}
+		// huge pages need 2 MiB alignment,
+		// map more and trim the excess
+		void	*p = mmap(0, cls + HUGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(MAP_FAILED == p)
+			return 0;
+		const uintptr_t	beg = (uintptr_t)p,
+				aligned = (beg + HUGE_SIZE - 1) & ~(uintptr_t)(HUGE_SIZE - 1);
+		if(aligned > beg)
+			munmap(p, aligned - beg);
+		if(aligned + cls < beg + cls + HUGE_SIZE)
+			munmap((void*)(aligned + cls), beg + HUGE_SIZE - aligned);
+		// it's only an hint
+		madvise((void*)aligned, cls, MADV_HUGEPAGE);
+		return (uint8_t*)aligned;
+	}
+}
+
+memory::buffer_pool::buffer_pool(const size_t max_cached) : max_cached_(max_cached) {
+}
+
+memory::buffer_pool::~buffer_pool() {
+	for(auto& f : free_) {
+		for(auto& p : f.second)
+			munmap(p, f.first);
+	}
+}
+
+size_t memory::buffer_pool::class_size(const size_t sz) {
+	if(sz > HUGE_SIZE)
+		return (sz + HUGE_SIZE - 1) & ~(HUGE_SIZE - 1);
+	size_t	cls = PAGE_SIZE;
+	while(cls < sz)
+		cls <<= 1;
+	return cls;
+}
+
+uint8_t* memory::buffer_pool::get(const size_t sz) {
+	const size_t	cls = class_size(sz);
+	uint8_t		*rv = 0;
+	auto		it = free_.find(cls);
+	if((it != free_.end()) && !it->second.empty()) {
+		rv = it->second.back();
+		it->second.pop_back();
+		stats_.cached -= cls;
+		++stats_.reuses;
+	} else {
+		rv = map_buffer(cls);
+		if(!rv)
+			throw std::runtime_error((std::string("Can't allocate buffer of size ") + std::to_string(cls) + ": " + strerror(errno)).c_str());
+		++stats_.mmaps;
+		::stats::add(::stats::BUF_MMAPS);
+	}
+	stats_.in_use += cls;
+	if(stats_.in_use > stats_.peak)
+		stats_.peak = stats_.in_use;
+	return rv;
+}
+
+void memory::buffer_pool::put(uint8_t* p, const size_t sz) {
+	if(!p)
+		return;
+	const size_t	cls = class_size(sz);
+	stats_.in_use -= cls;
+	++stats_.releases;
+	if(stats_.cached + cls > max_cached_) {
+		munmap(p, cls);
+		++stats_.munmaps;
+		return;
+	}
+	// the pages go back to the kernel
+	// (lazily), the mapping stays
+	if(madvise(p, cls, MADV_FREE))
+		madvise(p, cls, MADV_DONTNEED);
+	free_[cls].push_back(p);
+	stats_.cached += cls;
+}
+
@@ -0,0 +1,77 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _BUFPOOL_H_
+#define _BUFPOOL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+namespace memory {
+	// mmap backed buffers for the mirrored regions;
+	// sizes are rounded up to size classes (powers
+	// of 2 up to 2 MiB, then multiples of 2 MiB, which
+	// get transparent huge pages) and released buffers
+	// are kept for reuse, up to max_cached bytes, after
+	// their pages have been given back with MADV_FREE
+	class buffer_pool {
+	public:
+		struct stats {
+			size_t	mmaps = 0,
+				munmaps = 0,
+				reuses = 0,
+				releases = 0,
+				in_use = 0,
+				cached = 0,
+				peak = 0;
+		};
+	private:
+		size_t							max_cached_;
+		std::unordered_map<size_t, std::vector<uint8_t*>>	free_;
+		stats							stats_;
+
+		buffer_pool(const buffer_pool&) = delete;
+		buffer_pool& operator=(const buffer_pool&) = delete;
+	public:
+		buffer_pool(const size_t max_cached = 256*1024*1024);
+
+		~buffer_pool();
+
+		// returns a buffer of at least sz bytes, content
+		// is undefined; throws if it can't be allocated
+		uint8_t* get(const size_t sz);
+
+		// sz has to be the same as in get
+		void put(uint8_t* p, const size_t sz);
+
+		// buffers already cached are kept
+		void set_max_cached(const size_t max_cached) {
+			max_cached_ = max_cached;
+		}
+
+		const stats& get_stats(void) const {
+			return stats_;
+		}
+
+		static size_t class_size(const size_t sz);
+	};
+}
+
+#endif //_BUFPOOL_H_
+
@@ -0,0 +1,431 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "datastream.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+	// numbers are formatted by hand, no
+	// locale nor printf parsing involved
+	void put_uint(std::string& o, uint64_t v) {
+		char	buf[24];
+		char	*p = buf + sizeof(buf);
+		do {
+			*--p = '0' + (v % 10);
+			v /= 10;
+		} while(v);
+		o.append(p, buf + sizeof(buf) - p);
+	}
+
+	void put_int(std::string& o, const int64_t v) {
+		if(v < 0) {
+			o += '-';
+			put_uint(o, -(uint64_t)v);
+		} else {
+			put_uint(o, v);
+		}
+	}
+
+	// fixed, 2 decimals; values which are not
+	// finite (or garbage) become 'invalid'
+	void put_float(std::string& o, const float v, const char* invalid) {
+		if(!std::isfinite(v) || std::fabs(v) >= 1e15) {
+			o += invalid;
+			return;
+		}
+		int64_t	c = std::llround((double)v*100.0);
+		if(c < 0) {
+			o += '-';
+			c = -c;
+		}
+		put_uint(o, c/100);
+		o += '.';
+		o += (char)('0' + (c % 100)/10);
+		o += (char)('0' + c % 10);
+	}
+
+	void put_utf8(std::string& o, const uint32_t c) {
+		if(c < 0x80) {
+			o += (char)c;
+		} else if(c < 0x800) {
+			o += (char)(0xC0 | (c >> 6));
+			o += (char)(0x80 | (c & 0x3F));
+		} else if(c < 0x10000) {
+			o += (char)(0xE0 | (c >> 12));
+			o += (char)(0x80 | ((c >> 6) & 0x3F));
+			o += (char)(0x80 | (c & 0x3F));
+		} else if(c < 0x110000) {
+			o += (char)(0xF0 | (c >> 18));
+			o += (char)(0x80 | ((c >> 12) & 0x3F));
+			o += (char)(0x80 | ((c >> 6) & 0x3F));
+			o += (char)(0x80 | (c & 0x3F));
+		}
+	}
+
+	// MH:W strings are NUL padded
+	template<typename C>
+	void put_json_str(std::string& o, const C* s, const size_t len) {
+		const char	*hex = "0123456789abcdef";
+		o += '"';
+		for(size_t i = 0; i < len && s[i]; ++i) {
+			const uint32_t	c = (uint32_t)(typename std::make_unsigned<C>::type)s[i];
+			if(c == '"' || c == '\\') {
+				o += '\\';
+				o += (char)c;
+			} else if(c < 0x20) {
+				o += "\\u00";
+				o += hex[c >> 4];
+				o += hex[c & 0x0F];
+			} else if(sizeof(C) == 1) {
+				// already UTF-8
+				o += (char)c;
+			} else {
+				put_utf8(o, c);
+			}
+		}
+		o += '"';
+	}
+
+	template<typename C>
+	void put_csv_str(std::string& o, const C* s, const size_t len) {
+		o += '"';
+		for(size_t i = 0; i < len && s[i]; ++i) {
+			const uint32_t	c = (uint32_t)(typename std::make_unsigned<C>::type)s[i];
+			if(c == '"')
+				o += '"';
+			if(sizeof(C) == 1)
+				o += (char)c;
+			else
+				put_utf8(o, c);
+		}
+		o += '"';
+	}
+
+	void put_json_str(std::string& o, const std::wstring& s) {
+		put_json_str(o, s.c_str(), s.size());
+	}
+
+	void put_json_str(std::string& o, const char* s) {
+		put_json_str(o, s, std::strlen(s));
+	}
+
+	void put_csv_str(std::string& o, const std::wstring& s) {
+		put_csv_str(o, s.c_str(), s.size());
+	}
+
+	void put_csv_str(std::string& o, const char* s) {
+		put_csv_str(o, s, std::strlen(s));
+	}
+
+	// writes the commas of a JSON object
+	class json_obj {
+		std::string&	o_;
+		bool		first_;
+	public:
+		json_obj(std::string& o) : o_(o), first_(true) {
+			o_ += '{';
+		}
+
+		std::string& key(const char* k) {
+			if(!first_)
+				o_ += ',';
+			first_ = false;
+			o_ += '"';
+			o_ += k;
+			o_ += "\":";
+			return o_;
+		}
+
+		void close(void) {
+			o_ += '}';
+		}
+	};
+
+	// NaN is not equal to itself
+	bool differ(const float a, const float b) {
+		return (a != b) && !(std::isnan(a) && std::isnan(b));
+	}
+
+	const char	*BOOLS[] = { "false", "true" };
+
+	// writes the fields of player/monster which have
+	// changed from the previous; all when all is set;
+	// returns true if anything has been written
+	bool json_player(std::string& o, const size_t slot, const ui::mhw_data::player_info& p, const ui::mhw_data::player_info& prev, const bool all) {
+		const size_t	mark = o.size();
+		bool		any = false;
+		json_obj	j(o);
+		put_uint(j.key("slot"), slot);
+		if(!p.used) {
+			j.key("used") += "false";
+			j.close();
+			return true;
+		}
+		if(all || p.name != prev.name) { put_json_str(j.key("name"), p.name); any = true; }
+		if(all || p.damage != prev.damage) { put_int(j.key("damage"), p.damage); any = true; }
+		if(all || differ(p.dps_short, prev.dps_short)) { put_float(j.key("dps_short"), p.dps_short, "null"); any = true; }
+		if(all || differ(p.dps_long, prev.dps_long)) { put_float(j.key("dps_long"), p.dps_long, "null"); any = true; }
+		if(all || differ(p.dps_hunt, prev.dps_hunt)) { put_float(j.key("dps_hunt"), p.dps_hunt, "null"); any = true; }
+		if(all || differ(p.dps_peak, prev.dps_peak)) { put_float(j.key("dps_peak"), p.dps_peak, "null"); any = true; }
+		if(all || p.left_session != prev.left_session) { j.key("left_session") += BOOLS[p.left_session]; any = true; }
+		if(!any) {
+			o.resize(mark);
+			return false;
+		}
+		j.close();
+		return true;
+	}
+
+	bool json_monster(std::string& o, const size_t slot, const ui::mhw_data::monster_info& m, const ui::mhw_data::monster_info& prev, const bool all) {
+		const size_t	mark = o.size();
+		bool		any = false;
+		json_obj	j(o);
+		put_uint(j.key("slot"), slot);
+		if(!m.used) {
+			j.key("used") += "false";
+			j.close();
+			return true;
+		}
+		if(all || std::strcmp(m.name, prev.name)) { put_json_str(j.key("name"), m.name); any = true; }
+		if(all || differ(m.hp_current, prev.hp_current)) { put_float(j.key("hp_current"), m.hp_current, "null"); any = true; }
+		if(all || differ(m.hp_total, prev.hp_total)) { put_float(j.key("hp_total"), m.hp_total, "null"); any = true; }
+		if(all || differ(m.body_size, prev.body_size)) { put_float(j.key("body_size"), m.body_size, "null"); any = true; }
+		if(all || std::strcmp(m.crown, prev.crown)) { put_json_str(j.key("crown"), m.crown); any = true; }
+		if(!any) {
+			o.resize(mark);
+			return false;
+		}
+		j.close();
+		return true;
+	}
+}
+
+bool datastream::parse_format(const char* name, format& f) {
+	if(!std::strcmp(name, "ndjson")) {
+		f = NDJSON;
+		return true;
+	}
+	if(!std::strcmp(name, "csv")) {
+		f = CSV;
+		return true;
+	}
+	return false;
+}
+
+datastream::writer::writer(const char* fname, const format fmt, const bool delta) : fmt_(fmt), delta_(delta), fname_((fname && std::strcmp(fname, "-")) ? fname : ""), fd_(-1), own_fd_(false), pending_(0), first_(true), full_(true) {
+	if(fname_.empty()) {
+		fd_ = STDOUT_FILENO;
+		// a terminal shares its flags
+		// with stderr, leave it alone
+		if(!isatty(fd_))
+			fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+		return;
+	}
+	try_open();
+}
+
+bool datastream::writer::try_open(void) {
+	if(-1 != fd_)
+		return true;
+	// on a FIFO this fails with ENXIO
+	// until there is a reader
+	fd_ = open(fname_.c_str(), O_WRONLY|O_CREAT|O_NONBLOCK|O_CLOEXEC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if(-1 == fd_) {
+		if(ENXIO == errno)
+			return false;
+		throw std::runtime_error((std::string("Can't open data stream '") + fname_ + "': " + strerror(errno)).c_str());
+	}
+	own_fd_ = true;
+	struct stat	st;
+	if(!fstat(fd_, &st) && S_ISREG(st.st_mode) && ftruncate(fd_, 0))
+		throw std::runtime_error((std::string("Can't truncate data stream '") + fname_ + "': " + strerror(errno)).c_str());
+	return true;
+}
+
+datastream::writer::~writer() {
+	if(own_fd_)
+		close(fd_);
+}
+
+void datastream::writer::append_ndjson(const uint64_t ts_ms, const ui::mhw_data& d) {
+	const bool	full = !delta_ || full_;
+	bool		any = full;
+	json_obj	j(buf_);
+	put_uint(j.key("ts_ms"), ts_ms);
+	if(full || d.hunt != prev_.hunt) { j.key("hunt") += BOOLS[d.hunt]; any = true; }
+	if(full || d.waiting != prev_.waiting) { j.key("waiting") += BOOLS[d.waiting]; any = true; }
+	if(full || d.session_id != prev_.session_id) { put_json_str(j.key("session_id"), d.session_id); any = true; }
+	if(full || d.host_name != prev_.host_name) { put_json_str(j.key("host_name"), d.host_name); any = true; }
+	// players
+	{
+		const size_t	mark = buf_.size();
+		bool		first = true;
+		j.key("players") += '[';
+		for(size_t i = 0; i < sizeof(d.players)/sizeof(d.players[0]); ++i) {
+			const auto	&p = d.players[i],
+					&pp = prev_.players[i];
+			if(!p.used && (full || !pp.used))
+				continue;
+			const size_t	sep = buf_.size();
+			if(!first)
+				buf_ += ',';
+			if(json_player(buf_, i, p, pp, full || !pp.used))
+				first = false;
+			else
+				buf_.resize(sep);
+		}
+		buf_ += ']';
+		if(first && !full)
+			buf_.resize(mark);
+		any |= !first;
+	}
+	// monsters
+	{
+		const size_t	mark = buf_.size();
+		bool		first = true;
+		j.key("monsters") += '[';
+		for(size_t i = 0; i < sizeof(d.monsters)/sizeof(d.monsters[0]); ++i) {
+			const auto	&m = d.monsters[i],
+					&pm = prev_.monsters[i];
+			if(!m.used && (full || !pm.used))
+				continue;
+			const size_t	sep = buf_.size();
+			if(!first)
+				buf_ += ',';
+			if(json_monster(buf_, i, m, pm, full || !pm.used))
+				first = false;
+			else
+				buf_.resize(sep);
+		}
+		buf_ += ']';
+		if(first && !full)
+			buf_.resize(mark);
+		any |= !first;
+	}
+	j.close();
+	buf_ += '\n';
+	if(!any)
+		buf_.clear();
+}
+
+void datastream::writer::append_csv(const uint64_t ts_ms, const ui::mhw_data& d) {
+	const bool	full = !delta_ || full_;
+	bool		any = full;
+	if(first_) {
+		buf_ += "ts_ms,hunt,waiting,session_id,host_name";
+		for(size_t i = 0; i < sizeof(d.players)/sizeof(d.players[0]); ++i) {
+			const std::string	p = ",player_" + std::to_string(i) + "_";
+			buf_ += p + "used" + p + "name" + p + "damage" + p + "dps_short" + p + "dps_long" + p + "dps_hunt" + p + "dps_peak" + p + "left_session";
+		}
+		for(size_t i = 0; i < sizeof(d.monsters)/sizeof(d.monsters[0]); ++i) {
+			const std::string	m = ",monster_" + std::to_string(i) + "_";
+			buf_ += m + "used" + m + "name" + m + "hp_current" + m + "hp_total" + m + "body_size" + m + "crown";
+		}
+		buf_ += '\n';
+	}
+	const size_t	mark = buf_.size();
+	put_uint(buf_, ts_ms);
+	// each field is preceded by its comma
+	auto	field = [&](const bool changed) -> bool {
+		buf_ += ',';
+		if(!full && !changed)
+			return false;
+		any |= changed;
+		return true;
+	};
+	if(field(d.hunt != prev_.hunt)) buf_ += (char)('0' + d.hunt);
+	if(field(d.waiting != prev_.waiting)) buf_ += (char)('0' + d.waiting);
+	if(field(d.session_id != prev_.session_id)) put_csv_str(buf_, d.session_id);
+	if(field(d.host_name != prev_.host_name)) put_csv_str(buf_, d.host_name);
+	for(size_t i = 0; i < sizeof(d.players)/sizeof(d.players[0]); ++i) {
+		const auto	&p = d.players[i],
+				&pp = prev_.players[i];
+		if(field(p.used != pp.used)) buf_ += (char)('0' + p.used);
+		if(field(p.name != pp.name)) put_csv_str(buf_, p.name);
+		if(field(p.damage != pp.damage)) put_int(buf_, p.damage);
+		if(field(differ(p.dps_short, pp.dps_short))) put_float(buf_, p.dps_short, "");
+		if(field(differ(p.dps_long, pp.dps_long))) put_float(buf_, p.dps_long, "");
+		if(field(differ(p.dps_hunt, pp.dps_hunt))) put_float(buf_, p.dps_hunt, "");
+		if(field(differ(p.dps_peak, pp.dps_peak))) put_float(buf_, p.dps_peak, "");
+		if(field(p.left_session != pp.left_session)) buf_ += (char)('0' + p.left_session);
+	}
+	for(size_t i = 0; i < sizeof(d.monsters)/sizeof(d.monsters[0]); ++i) {
+		const auto	&m = d.monsters[i],
+				&pm = prev_.monsters[i];
+		if(field(m.used != pm.used)) buf_ += (char)('0' + m.used);
+		if(field(std::strcmp(m.name, pm.name))) put_csv_str(buf_, m.name);
+		if(field(differ(m.hp_current, pm.hp_current))) put_float(buf_, m.hp_current, "");
+		if(field(differ(m.hp_total, pm.hp_total))) put_float(buf_, m.hp_total, "");
+		if(field(differ(m.body_size, pm.body_size))) put_float(buf_, m.body_size, "");
+		if(field(std::strcmp(m.crown, pm.crown))) put_csv_str(buf_, m.crown);
+	}
+	buf_ += '\n';
+	if(!any)
+		buf_.resize(mark);
+}
+
+bool datastream::writer::flush(void) {
+	while(pending_) {
+		const ssize_t	rv = write(fd_, buf_.data() + buf_.size() - pending_, pending_);
+		if(rv < 0) {
+			if(EINTR == errno)
+				continue;
+			if(EAGAIN == errno)
+				return false;
+			// the reader of a FIFO is gone, wait
+			// for the next one (header included)
+			if(EPIPE == errno && own_fd_) {
+				close(fd_);
+				fd_ = -1;
+				own_fd_ = false;
+				pending_ = 0;
+				buf_.clear();
+				first_ = full_ = true;
+				return false;
+			}
+			throw std::runtime_error((std::string("Can't write data stream: ") + strerror(errno)).c_str());
+		}
+		pending_ -= rv;
+	}
+	buf_.clear();
+	return true;
+}
+
+void datastream::writer::append(const uint64_t ts_ms, const ui::mhw_data& d) {
+	// the reader is behind or not there yet, drop
+	// this record; then the next one is full
+	if(!try_open() || !flush()) {
+		full_ = true;
+		return;
+	}
+	if(NDJSON == fmt_)
+		append_ndjson(ts_ms, d);
+	else
+		append_csv(ts_ms, d);
+	first_ = full_ = false;
+	if(delta_)
+		prev_ = d;
+	pending_ = buf_.size();
+	flush();
+}
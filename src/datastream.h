@@ -0,0 +1,94 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _DATASTREAM_H_
+#define _DATASTREAM_H_
+
+#include <string>
+#include <cstdint>
+#include "ui.h"
+
+// Machine readable stream of the sampled data (see
+// --headless), one record per tick either as NDJSON
+// or CSV; in delta mode only the fields which changed
+// since the previous record are written, and ticks
+// without any change are not written at all
+//
+// NDJSON:
+//   {"ts_ms":...,"hunt":...,"waiting":...,"session_id":"...","host_name":"...",
+//    "players":[{"slot":0,"name":"...","damage":...,"dps_short":...,
+//    "dps_long":...,"dps_hunt":...,"dps_peak":...,"left_session":...}],
+//    "monsters":[{"slot":0,"name":"...","hp_current":...,"hp_total":...,
+//    "body_size":...,"crown":"..."}]}
+//   full records only list the used slots, delta records list the
+//   slots which changed, with '"used":false' once a slot is freed
+//
+// CSV:
+//   one column per field, per player and monster slot (see header);
+//   in delta mode unchanged fields are empty
+//
+// Writes never block: a FIFO is opened once it has a reader (again
+// after the reader goes away), and records are dropped while the
+// reader is behind (the next written one is then a full record)
+
+namespace datastream {
+	enum format {
+		NDJSON = 0,
+		CSV
+	};
+
+	extern bool parse_format(const char* name, format& f);
+
+	class writer {
+		const format	fmt_;
+		const bool	delta_;
+		const std::string	fname_;
+		int		fd_;
+		bool		own_fd_;
+		std::string	buf_;
+		// not yet written
+		size_t		pending_;
+		ui::mhw_data	prev_;
+		// first_ is the CSV header, full_
+		// a full record after drops
+		bool		first_,
+				full_;
+
+		writer(const writer&) = delete;
+		writer& operator=(const writer&) = delete;
+
+		void append_ndjson(const uint64_t ts_ms, const ui::mhw_data& d);
+
+		void append_csv(const uint64_t ts_ms, const ui::mhw_data& d);
+
+		// opens fname_ if not yet, false
+		// when it has no reader
+		bool try_open(void);
+
+		// false if not all buf_ could be written
+		bool flush(void);
+	public:
+		// fname can be a FIFO, 0 or "-" means stdout
+		writer(const char* fname, const format fmt, const bool delta);
+
+		~writer();
+
+		void append(const uint64_t ts_ms, const ui::mhw_data& d);
+	};
+}
+
+#endif //_DATASTREAM_H_
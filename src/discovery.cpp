@@ -0,0 +1,124 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "discovery.h"
+#include "utils.h"
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <unistd.h>
+
+namespace {
+	const size_t	MSG_SIZE = NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(struct proc_event));
+}
+
+bool discovery::watcher::send_op(const int op) {
+	alignas(struct nlmsghdr) char	buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(int))] = {0};
+	struct nlmsghdr			*nlh = (struct nlmsghdr*)buf;
+	struct cn_msg			*cn = (struct cn_msg*)NLMSG_DATA(nlh);
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(int));
+	nlh->nlmsg_type = NLMSG_DONE;
+	nlh->nlmsg_pid = getpid();
+	cn->id.idx = CN_IDX_PROC;
+	cn->id.val = CN_VAL_PROC;
+	cn->len = sizeof(int);
+	std::memcpy(cn->data, &op, sizeof(int));
+	return send(fd_, nlh, nlh->nlmsg_len, 0) == (ssize_t)nlh->nlmsg_len;
+}
+
+discovery::watcher::watcher() : fd_(socket(PF_NETLINK, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, NETLINK_CONNECTOR)), listening_(false) {
+	if(-1 == fd_)
+		return;
+	struct sockaddr_nl	sa = {0};
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = CN_IDX_PROC;
+	sa.nl_pid = 0;
+	if(bind(fd_, (struct sockaddr*)&sa, sizeof(sa))) {
+		close(fd_);
+		fd_ = -1;
+	}
+}
+
+discovery::watcher::~watcher() {
+	if(-1 == fd_)
+		return;
+	if(listening_)
+		send_op(PROC_CN_MCAST_IGNORE);
+	close(fd_);
+}
+
+void discovery::watcher::listen(const bool on) {
+	if((-1 == fd_) || (on == listening_))
+		return;
+	// usually fails without CAP_NET_ADMIN,
+	// then we just can't use this
+	if(!send_op(on ? PROC_CN_MCAST_LISTEN : PROC_CN_MCAST_IGNORE)) {
+		if(on) {
+			close(fd_);
+			fd_ = -1;
+		}
+		return;
+	}
+	listening_ = on;
+}
+
+bool discovery::watcher::read(std::vector<pid_t>& pids) {
+	alignas(struct nlmsghdr) char	buf[MSG_SIZE*32];
+	pids.clear();
+	while(true) {
+		const ssize_t	rb = recv(fd_, buf, sizeof(buf), 0);
+		if(rb < 0) {
+			// ENOBUFS means we've lost
+			// events, keep on reading
+			if(ENOBUFS == errno || EINTR == errno)
+				continue;
+			if(EAGAIN == errno || EWOULDBLOCK == errno)
+				break;
+			throw std::runtime_error((std::string("Can't read from proc connector: ") + strerror(errno)).c_str());
+		}
+		int	len = rb;
+		for(struct nlmsghdr *nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			if((NLMSG_NOOP == nlh->nlmsg_type) || (NLMSG_ERROR == nlh->nlmsg_type))
+				continue;
+			const struct cn_msg	*cn = (const struct cn_msg*)NLMSG_DATA(nlh);
+			if((CN_IDX_PROC != cn->id.idx) || (CN_VAL_PROC != cn->id.val))
+				continue;
+			// Wine execs MH:W and then sets its
+			// name, it may be matched on either
+			const struct proc_event	*ev = (const struct proc_event*)cn->data;
+			pid_t			cur = -1;
+			if(proc_event::PROC_EVENT_EXEC == ev->what) {
+				cur = ev->event_data.exec.process_tgid;
+			} else if(proc_event::PROC_EVENT_COMM == ev->what) {
+				// threads get names too
+				if((ev->event_data.comm.process_pid == ev->event_data.comm.process_tgid) && utils::is_mhw_comm(ev->event_data.comm.comm))
+					cur = ev->event_data.comm.process_tgid;
+			}
+			// exec and comm of the same
+			// one are reported once
+			if((-1 != cur) && (pids.end() == std::find(pids.begin(), pids.end(), cur)) && utils::is_mhw_pid(cur))
+				pids.push_back(cur);
+		}
+	}
+	return !pids.empty();
+}
+
@@ -0,0 +1,62 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _DISCOVERY_H_
+#define _DISCOVERY_H_
+
+#include <vector>
+#include <sys/types.h>
+
+// Notifies when MH:W is started, through the kernel
+// proc connector (exec and comm change events);
+// this needs CAP_NET_ADMIN, when not available
+// fd() is -1 and /proc has to be scanned instead
+
+namespace discovery {
+	class watcher {
+		int	fd_;
+		bool	listening_;
+
+		watcher(const watcher&) = delete;
+		watcher& operator=(const watcher&) = delete;
+
+		bool send_op(const int op);
+	public:
+		watcher();
+
+		~watcher();
+
+		// -1 when the proc connector
+		// can't be used
+		int fd(void) const {
+			return fd_;
+		}
+
+		// start/stop receiving events, these are
+		// only relevant while waiting for MH:W
+		void listen(const bool on);
+
+		// to be invoked when fd() is readable, reads all
+		// pending events; returns true if MH:W has been
+		// started, pids gets all the new ones in order
+		// (more than one may start at once)
+		bool read(std::vector<pid_t>& pids);
+	};
+}
+
+#endif //_DISCOVERY_H_
+
@@ -19,74 +19,209 @@
 #define _EVENTS_
 
 #include <stdexcept>
+#include <functional>
+#include <initializer_list>
+#include <unordered_map>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <csignal>
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <string.h>
-#include "timer.h"
+#include "trace.h"
 
-// usually you want to use this class with
-// fd == STDIN_FILENO
+// epoll based reactor: a periodic tick on
+// absolute deadlines (timerfd), signals
+// (signalfd) and any other fd, usually
+// STDIN_FILENO; signals have to be set
+// up before any other thread is started
+// because these get blocked
 
 namespace events {
 
-	class fd_proc {
-		int	efd_,
-			fd_;
+	class reactor {
+	public:
+		typedef std::function<void(const uint32_t ev)>		fd_handler;
+		typedef std::function<void(const uint64_t n_ticks)>	tick_handler;
+		typedef std::function<void(const int signo)>		sig_handler;
+
+		// how late the ticks have been
+		// dispatched, in usec
+		struct jitter_stats {
+			uint64_t	ticks = 0,
+					missed = 0,
+					sum_us = 0,
+					max_us = 0;
+		};
+	private:
+		const static int	N_EVENTS = 8;
+
+		int						efd_,
+								tfd_,
+								sfd_;
+		sigset_t					sigs_,
+								old_sigs_;
+		std::unordered_map<int, fd_handler>		fds_;
+		tick_handler					on_tick_;
+		sig_handler					on_sig_;
+		uint64_t					period_ns_,
+								next_ns_;
+		jitter_stats					jitter_;
+
+		reactor(const reactor&) = delete;
+		reactor& operator=(const reactor&) = delete;
+
+		static uint64_t now_ns(void) {
+			struct timespec	ts = {0};
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return ts.tv_sec*1000000000UL + ts.tv_nsec;
+		}
+
+		static std::string err_str(const char* msg) {
+			return std::string(msg) + strerror(errno);
+		}
 
-		fd_proc(const fd_proc&) = delete;
-		fd_proc& operator=(const fd_proc&) = delete;
+		void add_epoll(const int fd, const uint32_t ev) {
+			struct epoll_event	event = {0};
+			event.events = ev;
+			event.data.fd = fd;
+			if(epoll_ctl(efd_, EPOLL_CTL_ADD, fd, &event))
+				throw std::runtime_error(err_str("Can't add fd to epoll fd: "));
+		}
+
+		void dispatch_tick(void) {
+			uint64_t	n = 0;
+			if(sizeof(n) != read(tfd_, &n, sizeof(n))) {
+				if(EAGAIN == errno)
+					return;
+				throw std::runtime_error(err_str("Error in reading timerfd: "));
+			}
+			// jitter is measured against the
+			// last deadline which has expired
+			const uint64_t	now = now_ns(),
+					last_ns = next_ns_ + (n-1)*period_ns_,
+					late_us = (now > last_ns) ? (now - last_ns)/1000 : 0;
+			next_ns_ += n*period_ns_;
+			jitter_.ticks += n;
+			jitter_.missed += n-1;
+			jitter_.sum_us += late_us;
+			if(late_us > jitter_.max_us)
+				jitter_.max_us = late_us;
+			on_tick_(n);
+		}
+
+		void dispatch_signal(void) {
+			struct signalfd_siginfo	si;
+			while(sizeof(si) == read(sfd_, &si, sizeof(si)))
+				on_sig_(si.ssi_signo);
+		}
 	public:
-		fd_proc(int fd) : efd_(epoll_create1(0)), fd_(fd) {
+		reactor() : efd_(epoll_create1(EPOLL_CLOEXEC)), tfd_(-1), sfd_(-1), period_ns_(0), next_ns_(0) {
 			if(-1 == efd_)
-				throw std::runtime_error((std::string("Can't created epoll fd: ") + strerror(errno)).c_str());
-			// add stdin
-			struct epoll_event event = {0};
-    			event.events = EPOLLIN|EPOLLPRI|EPOLLERR;
-    			event.data.fd = fd_;
-    			if(epoll_ctl(efd_, EPOLL_CTL_ADD, fd_, &event)) {
-				close(efd_);
-				throw std::runtime_error((std::string("Can't add fd to epoll fd: ") + strerror(errno)).c_str());
+				throw std::runtime_error(err_str("Can't created epoll fd: "));
+			sigemptyset(&sigs_);
+			sigemptyset(&old_sigs_);
+		}
+
+		// invokes h every period_ms, the deadlines are
+		// absolute hence the tick doesn't drift with
+		// the time spent into the handlers
+		void set_tick(const size_t period_ms, tick_handler h) {
+			if(-1 != tfd_)
+				throw std::runtime_error("Tick already set");
+			tfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+			if(-1 == tfd_)
+				throw std::runtime_error(err_str("Can't create timerfd: "));
+			period_ns_ = period_ms*1000000UL;
+			next_ns_ = now_ns() + period_ns_;
+			struct itimerspec	its = {0};
+			its.it_interval.tv_sec = period_ns_/1000000000UL;
+			its.it_interval.tv_nsec = period_ns_%1000000000UL;
+			its.it_value.tv_sec = next_ns_/1000000000UL;
+			its.it_value.tv_nsec = next_ns_%1000000000UL;
+			if(timerfd_settime(tfd_, TFD_TIMER_ABSTIME, &its, 0))
+				throw std::runtime_error(err_str("Can't set timerfd: "));
+			on_tick_ = h;
+			add_epoll(tfd_, EPOLLIN);
+		}
+
+		// blocks sigs in the current thread (and the
+		// ones it will create) and delivers them to h
+		void set_signals(std::initializer_list<int> sigs, sig_handler h) {
+			if(-1 != sfd_)
+				throw std::runtime_error("Signals already set");
+			for(const auto& s : sigs)
+				sigaddset(&sigs_, s);
+			if(pthread_sigmask(SIG_BLOCK, &sigs_, &old_sigs_))
+				throw std::runtime_error("Can't block signals");
+			sfd_ = signalfd(-1, &sigs_, SFD_NONBLOCK|SFD_CLOEXEC);
+			if(-1 == sfd_) {
+				pthread_sigmask(SIG_SETMASK, &old_sigs_, 0);
+				throw std::runtime_error(err_str("Can't create signalfd: "));
 			}
+			on_sig_ = h;
+			add_epoll(sfd_, EPOLLIN);
 		}
 
-		// return true when need to do a refresh
-		// or when time timeout expires
-		bool do_io(const size_t msec_tmout) {
-			struct epoll_event	event = {0};
-			const timer::wall_tmr	tm;
-			const int		fds = epoll_wait(efd_, &event, 1, msec_tmout);
-			const size_t		msec_diff = tm.get(),
-						msec_todo = (msec_diff < msec_tmout) ? (msec_tmout - msec_diff) : 0;
-			if(0 == fds) return true;
-			else if (0 > fds) {
-				if(EINTR == errno) {
-					if(msec_todo) return do_io(msec_todo);
-					else return true;
-				}
-				throw std::runtime_error((std::string("Error in epoll_wait: ") + strerror(errno)).c_str());
+		void add_fd(const int fd, const uint32_t ev, fd_handler h) {
+			add_epoll(fd, ev);
+			fds_[fd] = h;
+		}
+
+		void remove_fd(const int fd) {
+			epoll_ctl(efd_, EPOLL_CTL_DEL, fd, 0);
+			fds_.erase(fd);
+		}
+
+		// waits for events and dispatches
+		// them, returns after one round
+		void run_once(void) {
+			struct epoll_event	events[N_EVENTS];
+			int			n = -1;
+			{
+				trace::scope	ts("wait");
+				n = epoll_wait(efd_, events, N_EVENTS, -1);
 			}
-			// we can only get 1 event at max...
-			if (event.data.fd == fd_) {
-				char		buf[128];
-            			// read input line
-            			const int	rb = read(fd_, &buf, 128);
-				if(rb > 0) {
-					 const auto rv = on_data(buf, rb);
-					 if(rv || !msec_todo) return true;
-					 else return do_io(msec_todo);
-				} else throw std::runtime_error((std::string("Error in reading fd: ") + strerror(errno)).c_str());
+			if(0 > n) {
+				// any other signal, the
+				// caller will come back
+				if(EINTR == errno)
+					return;
+				throw std::runtime_error(err_str("Error in epoll_wait: "));
+			}
+			for(int i = 0; i < n; ++i) {
+				const int	fd = events[i].data.fd;
+				if(fd == tfd_) {
+					dispatch_tick();
+				} else if(fd == sfd_) {
+					dispatch_signal();
+				} else {
+					// the handler may remove the fd
+					// itself, hence invoke a copy
+					const auto	it = fds_.find(fd);
+					if(it == fds_.end())
+						continue;
+					const fd_handler	h = it->second;
+					h(events[i].events);
+				}
 			}
-			// we should never hit this case
-			// because it would mean we have
-			// received data but not on our
-			// fd_ ?
-			return true;
 		}
 
-		// return true if we have to perform a refresh
-		virtual bool on_data(const char* p, const size_t sz) const = 0;
+		const jitter_stats& jitter(void) const {
+			return jitter_;
+		}
 
-		virtual ~fd_proc() {
+		~reactor() {
+			if(-1 != sfd_) {
+				close(sfd_);
+				pthread_sigmask(SIG_SETMASK, &old_sigs_, 0);
+			}
+			if(-1 != tfd_)
+				close(tfd_);
 			close(efd_);
 		}
 	};
@@ -16,7 +16,7 @@
  * */
 
 #include "fdisplay.h"
-#include "hashtext_fmt.h"
+#include "hashtext_brush.h"
 #include <string>
 #include <cstring>
 #include <cstdio>
@@ -26,9 +26,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <climits>
+#include <cerrno>
 
 namespace {
+	// explicit, umask doesn't apply
+	const mode_t	MODE = S_IRWXU|S_IRGRP|S_IROTH;
 
+	// tmp files are in the same directory
+	// of fname, so that rename is atomic
 	std::string get_basedir(const char *fname) {
 		const auto p = std::strrchr(fname, '/');
 		if(!p)
@@ -36,161 +42,83 @@ namespace {
 		return std::string(fname, p+1);
 	}
 
-	class fimpl : public vbrush::iface {
+	class fimpl : public ht_fmt::brush {
 		const std::string	fname_,
 		      			basedir_;
-		std::string		tmpfile_;
-		int			tmpfh_;
+		bool			o_tmpfile_;
 		uint32_t		iter_;
 
-		void write_attr(const uint32_t attr_mask) {
-			wchar_t	buf[2];
-			buf[0] = L'#';
-			buf[1] = (wchar_t)attr_mask;
-			if(8 != write(tmpfh_, buf, 8))
-					throw std::runtime_error("Can't write display file");
+		// returns a new file in basedir_, name is
+		// left empty when it's unnamed (O_TMPFILE)
+		int open_tmp(std::string& name) {
+			name.clear();
+			if(o_tmpfile_) {
+				const int	fd = open((basedir_.empty()) ? "." : basedir_.c_str(), O_TMPFILE|O_WRONLY|O_CLOEXEC, MODE);
+				if(-1 != fd)
+					return fd;
+				// kernel or filesystem without it
+				if(EISDIR != errno && EOPNOTSUPP != errno && EINVAL != errno)
+					return -1;
+				o_tmpfile_ = false;
+			}
+			// O_EXCL with a random name
+			char	buf[PATH_MAX];
+			if((size_t)std::snprintf(buf, sizeof(buf), "%s.lh-XXXXXX", basedir_.c_str()) >= sizeof(buf))
+				return -1;
+			const int	fd = mkostemp(buf, O_CLOEXEC);
+			if(-1 != fd)
+				name = buf;
+			return fd;
+		}
+
+		// links the unnamed file fd into basedir_;
+		// an existing name (symlinks too) is never
+		// followed nor replaced, just skipped
+		bool link_tmp(const int fd, std::string& name) {
+			const std::string	src = std::string("/proc/self/fd/") + std::to_string(fd);
+			while(true) {
+				name = basedir_ + ".lh-" + std::to_string(getpid()) + "-" + std::to_string(iter_++);
+				if(!linkat(AT_FDCWD, src.c_str(), AT_FDCWD, name.c_str(), AT_SYMLINK_FOLLOW))
+					return true;
+				if(EEXIST != errno) {
+					name.clear();
+					return false;
+				}
+			}
 		}
 	public:
-		fimpl(const char* fname) : fname_(fname), basedir_(get_basedir(fname)), tmpfh_(-1), iter_(0) {
+		fimpl(const char* fname) : fname_(fname), basedir_(get_basedir(fname)), o_tmpfile_(true), iter_(0) {
 			if(fname_.empty())
 				throw std::runtime_error("Empty file display name provided");
 		}
 
 		~fimpl() {
-			// remove the target file and tmp, don't care about
-			// results if we can remove of not
+			// remove the target file, don't care
+			// about results if we can remove of not
 			std::remove(fname_.c_str());
-			if(-1 != tmpfh_) {
-				close(tmpfh_);
-				std::remove(tmpfile_.c_str());
-			}
-		}
-
-		virtual bool init(void) {
-			// this logic should be ok for now; ideally should use
-			// opne(...) with O_TMPFILE and then renameat(...)
-			// create a tmp file
-			char	buf[256];
-			std::snprintf(buf, 255, "%slh-%dXXXXXX", basedir_.c_str(), iter_++);
-			tmpfh_ = mkstemp(buf);
-			if(-1 == tmpfh_)
-				return false;
-			tmpfile_ = buf;
-			return true;
-		}
-
-		virtual void draw_text(const char* t, const ssize_t len) {
-			const size_t	sz = std::strlen(t);
-			wchar_t		wbuf[sz+1];
-			for(size_t i = 0; i < sz; ++i)
-				wbuf[i] = t[i];
-			wbuf[sz] = L'\0';
-			draw_text(wbuf, len);
 		}
 
-		virtual void draw_text(const wchar_t* t, const ssize_t len) {
-			size_t		total_written = 0;
-			const wchar_t	*esc = std::wcschr(t, L'#');
-			while(esc) {
-				const size_t	sz = esc - t;
-				const ssize_t	rv = write(tmpfh_, t, sz*sizeof(wchar_t));
-				if(rv != (ssize_t)(sz*sizeof(wchar_t)))
-					throw std::runtime_error("Can't write display file");
-				// then write escaped '#'
-				if(8 != write(tmpfh_, L"##", 8))
-					throw std::runtime_error("Can't write display file");
-				t = esc + 1;
-				esc = std::wcschr(t, L'#');
-				total_written += sz+1;
-			}
-			const size_t	sz = std::wcslen(t);
-			const ssize_t	rv = write(tmpfh_, t, sz*sizeof(wchar_t));
-			if(rv != (ssize_t)(sz*sizeof(wchar_t)))
+		virtual void display(void) {
+			// a new tmp file in the same directory is
+			// then atomically renamed, so readers always
+			// see a full frame; with O_TMPFILE it only
+			// gets a name once fully written
+			std::string	tmpfile;
+			const int	fd = open_tmp(tmpfile);
+			if(-1 == fd)
+				throw std::runtime_error("Can't open display file");
+			const ssize_t	sz = buf_.size()*sizeof(wchar_t);
+			const bool	ok = !fchmod(fd, MODE) && (write(fd, buf_.data(), sz) == sz) && (!tmpfile.empty() || link_tmp(fd, tmpfile));
+			close(fd);
+			if(!ok) {
+				if(!tmpfile.empty())
+					std::remove(tmpfile.c_str());
 				throw std::runtime_error("Can't write display file");
-			total_written += sz;
-			const ssize_t	leftover = (len > 0) ? len - (ssize_t)total_written : 0;
-			if(leftover > 0) {
-				// we have some leftover empty chars
-				const static wchar_t	*W_SPACE = L" ";
-				for(ssize_t i = 0; i < leftover; ++i)
-					if(sizeof(wchar_t) != write(tmpfh_, W_SPACE, sizeof(wchar_t)))
-						throw std::runtime_error("Can't write display file");
-			}
-		}
-
-		virtual void next_row(const size_t n_rows) {
-			const static wchar_t	*W_NEWLINE = L"\n";
-			for(size_t i = 0; i < n_rows; ++i)
-				if(sizeof(wchar_t) != write(tmpfh_, W_NEWLINE, sizeof(wchar_t)))
-					throw std::runtime_error("Can't write display file");
-		}
-
-		virtual void set_attr_on(const vbrush::iface::attr a) {
-			switch(a) {
-			case BOLD: {
-				write_attr(ht_fmt::BOLD_ON);
-			} break;
-			case REVERSE: {
-				write_attr(ht_fmt::REVERSE_ON);
-			} break;
-			case DIM: {
-				write_attr(ht_fmt::DIM_ON);
-			} break;
-			case C_BLUE: {
-				write_attr(ht_fmt::BLUE_ON);
-			} break;
-			case C_MAGENTA: {
-				write_attr(ht_fmt::MAGENTA_ON);
-			} break;
-			case C_YELLOW: {
-				write_attr(ht_fmt::YELLOW_ON);
-			} break;
-			case C_GREEN: {
-				write_attr(ht_fmt::GREEN_ON);
-			} break;
-			default:
-				break;
-			}
-		}
-
-		virtual void set_attr_off(const vbrush::iface::attr a) {
-			switch(a) {
-			case BOLD: {
-				write_attr(ht_fmt::BOLD_OFF);
-			} break;
-			case REVERSE: {
-				write_attr(ht_fmt::REVERSE_OFF);
-			} break;
-			case DIM: {
-				write_attr(ht_fmt::DIM_OFF);
-			} break;
-			case C_BLUE: {
-				write_attr(ht_fmt::BLUE_OFF);
-			} break;
-			case C_MAGENTA: {
-				write_attr(ht_fmt::MAGENTA_OFF);
-			} break;
-			case C_YELLOW: {
-				write_attr(ht_fmt::YELLOW_OFF);
-			} break;
-			case C_GREEN: {
-				write_attr(ht_fmt::GREEN_OFF);
-			} break;
-
-			default:
-				break;
 			}
-		}
-
-		virtual void display(void) {
-			if(-1 == tmpfh_)
-				throw std::runtime_error("Can't display unintialized file");
-			close(tmpfh_);
-			tmpfh_ = -1;
-			if(chmod(tmpfile_.c_str(), S_IRWXU|S_IRGRP|S_IROTH))
-				throw std::runtime_error("Can't change permissions of display file");
-			if(std::rename(tmpfile_.c_str(), fname_.c_str()))
+			if(std::rename(tmpfile.c_str(), fname_.c_str())) {
+				std::remove(tmpfile.c_str());
 				throw std::runtime_error("Can't swap display file");
+			}
 		}
 	};
 }
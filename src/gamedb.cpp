@@ -0,0 +1,353 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "gamedb.h"
+#include "offsets.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+#include <iterator>
+#include <sys/uio.h>
+
+namespace {
+	// names of the offsets in a db file
+	const struct {
+		const char	*name;
+		size_t		off,
+				n,
+				// of typed fields
+				align;
+	}	FIELDS[] = {
+		{ "session_id", offsetof(gamedb::offsets_table, session_id), 1, 1 },
+		{ "session_host_player_name", offsetof(gamedb::offsets_table, session_host_player_name), 1, 1 },
+		{ "first_player_name", offsetof(gamedb::offsets_table, first_player_name), 1, 1 },
+		{ "player_name_stride", offsetof(gamedb::offsets_table, player_name_stride), 1, 1 },
+		{ "first_player_ptr", offsetof(gamedb::offsets_table, first_player_ptr), 1, 1 },
+		{ "next_player_ptr", offsetof(gamedb::offsets_table, next_player_ptr), 1, 1 },
+		{ "player_damage", offsetof(gamedb::offsets_table, player_damage), 1, 1 },
+		{ "monster_list", offsetof(gamedb::offsets_table, monster_list), 4, 1 },
+		{ "second_monster", offsetof(gamedb::offsets_table, second_monster), 1, 1 },
+		{ "monster_start_of_struct", offsetof(gamedb::offsets_table, monster_start_of_struct), 1, 1 },
+		{ "previous_monster", offsetof(gamedb::offsets_table, previous_monster), 1, 1 },
+		{ "monster_model_id", offsetof(gamedb::offsets_table, monster_model_id), 1, 1 },
+		{ "monster_size_scale", offsetof(gamedb::offsets_table, monster_size_scale), 1, alignof(offsets::Monster::MonsterSizeScale::type) },
+		{ "monster_health_component", offsetof(gamedb::offsets_table, monster_health_component), 1, alignof(offsets::Monster::HealthComponentPtr::type) },
+		{ "monster_scale_modifier", offsetof(gamedb::offsets_table, monster_scale_modifier), 1, alignof(offsets::Monster::MonsterScaleModifier::type) },
+		{ "monster_num_id", offsetof(gamedb::offsets_table, monster_num_id), 1, alignof(offsets::Monster::MonsterNumID::type) },
+		{ "max_health", offsetof(gamedb::offsets_table, max_health), 1, alignof(offsets::MonsterHealthComponent::MaxHealth::type) },
+		{ "current_health", offsetof(gamedb::offsets_table, current_health), 1, alignof(offsets::MonsterHealthComponent::CurrentHealth::type) }
+	};
+
+	// fields read together have to fit
+	// a single schema::read_struct_at
+	bool fits_span(const uint32_t a, const uint32_t a_sz, const uint32_t b, const uint32_t b_sz) {
+		if((a < b + b_sz) && (b < a + a_sz))
+			return false;
+		return std::max(a + a_sz, b + b_sz) - std::min(a, b) <= schema::MAX_SPAN;
+	}
+
+	uint32_t* field_ptr(gamedb::offsets_table& t, const size_t off) {
+		return (uint32_t*)((char*)&t + off);
+	}
+
+	std::string trim(const std::string& s) {
+		const auto	b = s.find_first_not_of(" \t\r"),
+				e = s.find_last_not_of(" \t\r");
+		return (b == std::string::npos) ? std::string() : s.substr(b, e - b + 1);
+	}
+
+	bool parse_num(const std::string& s, uint64_t& out, const int base = 0) {
+		if(s.empty())
+			return false;
+		char	*end = 0;
+		out = std::strtoull(s.c_str(), &end, base);
+		return !*end;
+	}
+
+	// same format as patterns.cpp
+	std::string pattern_text(const memory::pattern& p) {
+		std::vector<int>	bytes;
+		for(const auto& m : p.matches) {
+			if(bytes.size() < m.tgt_offset + m.length)
+				bytes.resize(m.tgt_offset + m.length, -1);
+			for(size_t i = 0; i < m.length; ++i)
+				bytes[m.tgt_offset + i] = p.bytes[m.src_offset + i];
+		}
+		std::string	rv;
+		for(const auto& b : bytes) {
+			char	buf[4];
+			if(b < 0)
+				std::snprintf(buf, 4, "?? ");
+			else
+				std::snprintf(buf, 4, "%02X ", b);
+			rv += buf;
+		}
+		if(!rv.empty())
+			rv.resize(rv.size() - 1);
+		return rv;
+	}
+
+	bool read_remote(const pid_t pid, const size_t addr, void* d, const size_t sz) {
+		const struct iovec	local = { d, sz },
+					remote = { (void*)addr, sz };
+		return (ssize_t)sz == process_vm_readv(pid, &local, 1, &remote, 1, 0);
+	}
+
+	// what is hashed of a PE image
+	struct pe_info {
+		uint8_t		coff[20];
+		uint32_t	size_of_image,
+				checksum;
+	};
+
+	// checks there is an x64 PE executable
+	// (not a DLL) mapped at addr
+	bool read_pe(const pid_t pid, const size_t addr, pe_info& pe) {
+		uint8_t		dos[0x40];
+		if(!read_remote(pid, addr, dos, sizeof(dos)) || dos[0] != 'M' || dos[1] != 'Z')
+			return false;
+		uint32_t	e_lfanew = 0;
+		std::memcpy(&e_lfanew, &dos[0x3c], sizeof(e_lfanew));
+		if(e_lfanew > 0x1000)
+			return false;
+		// signature, COFF header and the optional
+		// header up to CheckSum
+		uint8_t		nt[4 + 20 + 68];
+		if(!read_remote(pid, addr + e_lfanew, nt, sizeof(nt)) || std::memcmp(nt, "PE\0\0", 4))
+			return false;
+		uint16_t	characteristics = 0,
+				magic = 0;
+		std::memcpy(&characteristics, &nt[4 + 18], sizeof(characteristics));
+		std::memcpy(&magic, &nt[4 + 20], sizeof(magic));
+		// IMAGE_FILE_DLL and PE32+
+		if((characteristics & 0x2000) || (magic != 0x20b))
+			return false;
+		std::memcpy(pe.coff, &nt[4], sizeof(pe.coff));
+		std::memcpy(&pe.size_of_image, &nt[4 + 20 + 56], sizeof(pe.size_of_image));
+		std::memcpy(&pe.checksum, &nt[4 + 20 + 64], sizeof(pe.checksum));
+		return true;
+	}
+
+	// FNV-1a
+	uint64_t hash(const void* d, const size_t sz, uint64_t h = 0xcbf29ce484222325UL) {
+		const uint8_t	*p = (const uint8_t*)d;
+		for(size_t i = 0; i < sz; ++i) {
+			h ^= p[i];
+			h *= 0x100000001b3UL;
+		}
+		return h;
+	}
+}
+
+gamedb::offsets_table::offsets_table() {
+	namespace pnc = offsets::PlayerNameCollection;
+	namespace pdc = offsets::PlayerDamageCollection;
+	typedef offsets::Monster	mo;
+	session_id = pnc::SessionID;
+	session_host_player_name = pnc::SessionHostPlayerName;
+	first_player_name = pnc::FirstPlayerName;
+	player_name_stride = pnc::PlayerNameStride;
+	first_player_ptr = pdc::FirstPlayerPtr;
+	next_player_ptr = pdc::NextPlayerPtr;
+	player_damage = pdc::Damage;
+	static_assert(sizeof(monster_list) == sizeof(offsets::MonsterList::Chain), "Monster list chain size mismatch");
+	std::memcpy(monster_list, offsets::MonsterList::Chain, sizeof(monster_list));
+	second_monster = mo::SecondMonsterOffset;
+	monster_start_of_struct = mo::MonsterStartOfStructOffset;
+	previous_monster = mo::PreviousMonsterOffset;
+	monster_model_id = offsets::MonsterModel::IdStringOffset;
+	monster_size_scale = mo::MonsterSizeScale::offset;
+	monster_health_component = mo::HealthComponentPtr::offset;
+	monster_scale_modifier = mo::MonsterScaleModifier::offset;
+	monster_num_id = mo::MonsterNumID::offset;
+	max_health = offsets::MonsterHealthComponent::MaxHealth::offset;
+	current_health = offsets::MonsterHealthComponent::CurrentHealth::offset;
+}
+
+void gamedb::entry::apply(const size_t base, memory::pattern** b, memory::pattern** e) const {
+	for(memory::pattern** i = b; i < e; ++i) {
+		memory::pattern&	p = **i;
+		for(const auto& t : patterns) {
+			if(t.first == p.name)
+				p = memory::pattern(patterns::pattern{ t.first.c_str(), t.second.c_str() });
+		}
+		for(const auto& r : rvas) {
+			if(r.first == p.name)
+				p.mem_location = base + r.second;
+		}
+	}
+}
+
+void gamedb::db::load(const char* fname) {
+	std::ifstream	istr(fname);
+	if(!istr)
+		throw std::runtime_error((std::string("Can't open game database '") + fname + "'").c_str());
+	std::vector<entry>	entries;
+	std::string		line;
+	size_t			n_line = 0;
+	auto			fail = [&](const std::string& what) {
+		throw std::runtime_error((std::string("Game database '") + fname + "' line " + std::to_string(n_line) + ": " + what).c_str());
+	};
+	auto			check_last = [&](void) {
+		if(entries.empty())
+			return;
+		const entry&		e = *entries.rbegin();
+		const offsets_table&	o = e.offs;
+		if(!e.fp)
+			fail("entry '" + e.name + "' has no fingerprint");
+		if(!fits_span(o.monster_health_component, sizeof(offsets::Monster::HealthComponentPtr::type), o.monster_scale_modifier, sizeof(offsets::Monster::MonsterScaleModifier::type)))
+			fail("entry '" + e.name + "' offsets monster_health_component and monster_scale_modifier overlap or are too far apart");
+		if(!fits_span(o.max_health, sizeof(offsets::MonsterHealthComponent::MaxHealth::type), o.current_health, sizeof(offsets::MonsterHealthComponent::CurrentHealth::type)))
+			fail("entry '" + e.name + "' offsets max_health and current_health overlap or are too far apart");
+	};
+	while(std::getline(istr, line)) {
+		++n_line;
+		line = trim(line);
+		if(line.empty() || line[0] == '#')
+			continue;
+		if(line[0] == '[') {
+			if(*line.rbegin() != ']')
+				fail("missing ']'");
+			check_last();
+			entries.push_back(entry());
+			entries.rbegin()->name = trim(line.substr(1, line.size() - 2));
+			entries.rbegin()->fp = 0;
+			continue;
+		}
+		const auto	eq = line.find('=');
+		if(eq == std::string::npos)
+			fail("missing '='");
+		if(entries.empty())
+			fail("missing '[name]' of the entry");
+		entry&			e = *entries.rbegin();
+		std::istringstream	key(line.substr(0, eq));
+		std::string		kind,
+					name;
+		const std::string	value = trim(line.substr(eq + 1));
+		key >> kind >> name;
+		if(kind == "fingerprint") {
+			if(!parse_num(value, e.fp, 16) || !e.fp)
+				fail("invalid fingerprint '" + value + "'");
+			for(auto i = entries.begin(); i + 1 < entries.end(); ++i) {
+				if(i->fp == e.fp)
+					fail("fingerprint already used by '" + i->name + "'");
+			}
+		} else if(kind == "pattern" && !name.empty()) {
+			try {
+				memory::pattern(patterns::pattern{ name.c_str(), value.c_str() });
+			} catch(const std::exception& ex) {
+				fail(ex.what());
+			}
+			e.patterns.push_back(std::make_pair(name, value));
+		} else if(kind == "rva" && !name.empty()) {
+			uint64_t	rva = 0;
+			if(!parse_num(value, rva))
+				fail("invalid RVA '" + value + "'");
+			e.rvas.push_back(std::make_pair(name, (size_t)rva));
+		} else if(kind == "offset" && !name.empty()) {
+			const auto	*f = std::find_if(std::begin(FIELDS), std::end(FIELDS), [&name](decltype(FIELDS[0]) f) { return name == f.name; });
+			if(f == std::end(FIELDS))
+				fail("unknown offset '" + name + "'");
+			std::istringstream	vals(value);
+			std::string		v;
+			size_t			n = 0;
+			for(uint64_t u = 0; vals >> v; ++n) {
+				if(n >= f->n || !parse_num(v, u) || u > 0xffffffffUL)
+					fail("invalid offset '" + value + "'");
+				if(u % f->align)
+					fail("offset '" + name + "' is misaligned");
+				field_ptr(e.offs, f->off)[n] = u;
+			}
+			if(n != f->n)
+				fail("offset '" + name + "' needs " + std::to_string(f->n) + " values");
+		} else {
+			fail("unknown key '" + trim(line.substr(0, eq)) + "'");
+		}
+	}
+	check_last();
+	entries_.swap(entries);
+}
+
+const gamedb::entry* gamedb::db::find(const uint64_t fp) const {
+	for(const auto& e : entries_) {
+		if(e.fp == fp)
+			return &e;
+	}
+	return 0;
+}
+
+bool gamedb::fingerprint(const pid_t pid, uint64_t& fp, size_t& base) {
+	std::ifstream	istr(std::string("/proc/") + std::to_string(pid) + "/maps");
+	std::string	line;
+	bool		found = false,
+			named = false;
+	pe_info		best = pe_info();
+	while(std::getline(istr, line)) {
+		unsigned long	beg = 0,
+				end = 0;
+		char		perms[8] = "";
+		int		path = 0;
+		if(3 != std::sscanf(line.c_str(), "%lx-%lx %7s %*s %*s %*s %n", &beg, &end, perms, &path) || perms[0] != 'r')
+			continue;
+		pe_info		pe;
+		if(!read_pe(pid, beg, pe))
+			continue;
+		// prefer the image mapped from MonsterHunterWorld.exe,
+		// then the largest one (Wine may map it anonymously)
+		const bool	is_mhw = path && (line.find("MonsterHunterWorld.exe", path) != std::string::npos);
+		if(found && (named || (!is_mhw && pe.size_of_image <= best.size_of_image)))
+			continue;
+		found = true;
+		named = is_mhw;
+		best = pe;
+		base = beg;
+	}
+	if(!found)
+		return false;
+	fp = hash(&best.size_of_image, sizeof(best.size_of_image), hash(best.coff, sizeof(best.coff)));
+	fp = hash(&best.checksum, sizeof(best.checksum), fp);
+	return true;
+}
+
+void gamedb::dump(std::ostream& ostr, const uint64_t fp, const size_t base, memory::pattern** b, memory::pattern** e, const offsets_table& offs) {
+	char	buf[64];
+	std::snprintf(buf, sizeof(buf), "%016lx", fp);
+	ostr << "[" << buf << "]\nfingerprint = " << buf << "\n";
+	for(memory::pattern** i = b; i < e; ++i)
+		ostr << "pattern " << (*i)->name << " = " << pattern_text(**i) << "\n";
+	for(memory::pattern** i = b; i < e; ++i) {
+		if(((*i)->mem_location < 0) || ((size_t)(*i)->mem_location < base))
+			continue;
+		std::snprintf(buf, sizeof(buf), "0x%lx", (*i)->mem_location - base);
+		ostr << "rva " << (*i)->name << " = " << buf << "\n";
+	}
+	offsets_table	t(offs);
+	for(const auto& f : FIELDS) {
+		ostr << "offset " << f.name << " =";
+		for(size_t i = 0; i < f.n; ++i) {
+			std::snprintf(buf, sizeof(buf), " 0x%x", field_ptr(t, f.off)[i]);
+			ostr << buf;
+		}
+		ostr << "\n";
+	}
+	ostr << std::flush;
+}
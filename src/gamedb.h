@@ -0,0 +1,106 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _GAMEDB_H_
+#define _GAMEDB_H_
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <sys/types.h>
+#include "memory.h"
+
+// Per game build patterns, locations and offsets, loaded
+// at runtime (see --gamedb) so that a new MH:W build can
+// be supported without a rebuild; the build is told by
+// the PE header of the mapped MonsterHunterWorld.exe
+//
+//   # comment
+//   [15.11.01]
+//   fingerprint = 0123456789abcdef
+//   pattern PlayerDamage = 48 8B 0D ?? ?? ?? ?? E8
+//   rva PlayerDamage = 0x4d4e2a0
+//   offset monster_list = 0x698 0x0 0x138 0x0
+//
+// 'rva' is the location of a pattern relative to the
+// image base; patterns, locations and offsets not in
+// the entry take the built-in values
+
+namespace gamedb {
+	// offsets which change between game builds,
+	// the defaults are the ones in offsets.h
+	struct offsets_table {
+		uint32_t	session_id,
+				session_host_player_name,
+				first_player_name,
+				player_name_stride,
+				first_player_ptr,
+				next_player_ptr,
+				player_damage,
+				monster_list[4],
+				second_monster,
+				monster_start_of_struct,
+				previous_monster,
+				monster_model_id,
+				monster_size_scale,
+				monster_health_component,
+				monster_scale_modifier,
+				monster_num_id,
+				max_health,
+				current_health;
+
+		offsets_table();
+	};
+
+	struct entry {
+		std::string		name;
+		uint64_t		fp;
+		// pattern name and text
+		std::vector<std::pair<std::string, std::string>>	patterns;
+		// pattern name and RVA
+		std::vector<std::pair<std::string, size_t>>		rvas;
+		offsets_table		offs;
+
+		// replaces the patterns in [b, e) with the ones of
+		// this entry, located relative to image base
+		void apply(const size_t base, memory::pattern** b, memory::pattern** e) const;
+	};
+
+	class db {
+		std::vector<entry>	entries_;
+	public:
+		// throws on a malformed file
+		void load(const char* fname);
+
+		bool empty(void) const {
+			return entries_.empty();
+		}
+
+		const entry* find(const uint64_t fp) const;
+	};
+
+	// fingerprint and image base of the MH:W
+	// executable mapped in pid
+	extern bool fingerprint(const pid_t pid, uint64_t& fp, size_t& base);
+
+	// writes an entry with the patterns in [b, e)
+	// and offs, to be added to a db file
+	extern void dump(std::ostream& ostr, const uint64_t fp, const size_t base, memory::pattern** b, memory::pattern** e, const offsets_table& offs);
+}
+
+#endif //_GAMEDB_H_
@@ -0,0 +1,157 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "grid.h"
+
+namespace {
+	// switches the attributes of b from cur to tgt
+	void set_attrs(vbrush::iface* b, grid::attr_mask& cur, const grid::attr_mask tgt) {
+		for(int a = vbrush::iface::BOLD; a <= vbrush::iface::C_GREEN; ++a) {
+			if((cur & (1 << a)) && !(tgt & (1 << a)))
+				b->set_attr_off((vbrush::iface::attr)a);
+		}
+		for(int a = vbrush::iface::BOLD; a <= vbrush::iface::C_GREEN; ++a) {
+			if(!(cur & (1 << a)) && (tgt & (1 << a)))
+				b->set_attr_on((vbrush::iface::attr)a);
+		}
+		cur = tgt;
+	}
+}
+
+grid::frame::frame() : gen_(0), n_rows_(0), cur_row_(0), cur_attr_(0), kept_(false), keyed_(false) {
+}
+
+grid::frame::run& grid::frame::next_run(const bool wide, const ssize_t len) {
+	scratch_.resize(scratch_.size() + 1);
+	run&	r = scratch_.back();
+	r.attrs = cur_attr_;
+	r.wide = wide;
+	r.len = len;
+	return r;
+}
+
+void grid::frame::end_row(void) {
+	if(cur_row_ >= rows_.size()) {
+		rows_.resize(cur_row_ + 1);
+		rows_[cur_row_].gen = gen_;
+	}
+	row&	r = rows_[cur_row_];
+	if(kept_) {
+		kept_ = keyed_ = false;
+		return;
+	}
+	// a row without key has to be
+	// laid out every time
+	if(!keyed_)
+		r.key.clear();
+	keyed_ = false;
+	// the key may have changed but
+	// the content may have not
+	if(r.runs != scratch_) {
+		r.runs.swap(scratch_);
+		r.gen = gen_;
+	}
+	scratch_.clear();
+}
+
+bool grid::frame::init(void) {
+	++gen_;
+	cur_row_ = 0;
+	cur_attr_ = 0;
+	kept_ = keyed_ = false;
+	scratch_.clear();
+	return true;
+}
+
+void grid::frame::draw_text(const char* t, const ssize_t len) {
+	run&	r = next_run(false, len);
+	r.text.assign(t);
+	r.wtext.clear();
+}
+
+void grid::frame::draw_text(const wchar_t* t, const ssize_t len) {
+	run&	r = next_run(true, len);
+	r.wtext.assign(t);
+	r.text.clear();
+}
+
+void grid::frame::next_row(const size_t n_rows) {
+	for(size_t i = 0; i < n_rows; ++i) {
+		end_row();
+		++cur_row_;
+	}
+}
+
+void grid::frame::set_attr_on(const vbrush::iface::attr a) {
+	cur_attr_ |= (1 << a);
+}
+
+void grid::frame::set_attr_off(const vbrush::iface::attr a) {
+	cur_attr_ &= ~(1 << a);
+}
+
+void grid::frame::display(void) {
+	end_row();
+	n_rows_ = cur_row_ + 1;
+	// rows which are not part of this
+	// frame anymore are dropped, if they
+	// come back those will be new
+	rows_.resize(n_rows_);
+}
+
+bool grid::frame::same_row(const key& k) {
+	if((cur_row_ < rows_.size()) && (rows_[cur_row_].key == k.str())) {
+		kept_ = true;
+		return true;
+	}
+	if(cur_row_ >= rows_.size()) {
+		rows_.resize(cur_row_ + 1);
+		rows_[cur_row_].gen = gen_;
+	}
+	rows_[cur_row_].key = k.str();
+	keyed_ = true;
+	return false;
+}
+
+bool grid::frame::blit(vbrush::iface* b, uint64_t& gen) const {
+	if(!b->init()) {
+		// whatever b is showing now
+		// isn't this frame anymore
+		gen = 0;
+		return false;
+	}
+	attr_mask	cur = 0;
+	for(size_t i = 0; i < n_rows_; ++i) {
+		if(i)
+			b->next_row();
+		const row&	r = rows_[i];
+		if((r.gen <= gen) && b->keep_row())
+			continue;
+		for(const auto& ru : r.runs) {
+			set_attrs(b, cur, ru.attrs);
+			if(ru.wide)
+				b->draw_text(ru.wtext.c_str(), ru.len);
+			else
+				b->draw_text(ru.text.c_str(), ru.len);
+		}
+	}
+	set_attrs(b, cur, 0);
+	b->display();
+	gen = gen_;
+	return true;
+}
+
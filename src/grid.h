@@ -0,0 +1,126 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _GRID_H_
+#define _GRID_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "vbrush.h"
+
+namespace grid {
+	// bitmask of (1 << vbrush::iface::attr)
+	typedef uint16_t	attr_mask;
+
+	// the inputs a row is formatted from; when
+	// those don't change the row is kept as is
+	class key {
+		std::string	buf_;
+	public:
+		template<typename T>
+		key& operator()(const T& v) {
+			static_assert(std::is_arithmetic<T>::value, "grid::key only supports arithmetic types and strings");
+			buf_.append((const char*)&v, sizeof(v));
+			return *this;
+		}
+
+		key& operator()(const char* s) {
+			buf_.append(s, std::strlen(s) + 1);
+			return *this;
+		}
+
+		key& operator()(const std::wstring& s) {
+			buf_.append((const char*)s.c_str(), (s.size() + 1)*sizeof(wchar_t));
+			return *this;
+		}
+
+		const std::string& str(void) const {
+			return buf_;
+		}
+	};
+
+	// a frame laid out once and then drawn onto
+	// any number of vbrush::iface; it's meant
+	// to be reused, each row remembers in which
+	// generation it has last changed
+	class frame : public vbrush::iface {
+	public:
+		struct run {
+			attr_mask	attrs;
+			bool		wide;
+			std::string	text;
+			std::wstring	wtext;
+			ssize_t		len;
+
+			bool operator==(const run& rhs) const {
+				return (attrs == rhs.attrs) && (wide == rhs.wide) && (len == rhs.len) && (wide ? (wtext == rhs.wtext) : (text == rhs.text));
+			}
+		};
+
+		struct row {
+			uint64_t		gen;
+			std::string		key;
+			std::vector<run>	runs;
+		};
+	private:
+		uint64_t		gen_;
+		std::vector<row>	rows_;
+		size_t			n_rows_,
+					cur_row_;
+		attr_mask		cur_attr_;
+		bool			kept_,
+					keyed_;
+		std::vector<run>	scratch_;
+
+		run& next_run(const bool wide, const ssize_t len);
+		void end_row(void);
+	public:
+		frame();
+
+		// vbrush::iface, this lays out
+		// the frame, init() starts a new
+		// generation and display() ends it
+		virtual bool init(void);
+		virtual void draw_text(const char* t, const ssize_t len = -1);
+		virtual void draw_text(const wchar_t* t, const ssize_t len = -1);
+		virtual void next_row(const size_t n_rows = 1);
+		virtual void set_attr_on(const vbrush::iface::attr a);
+		virtual void set_attr_off(const vbrush::iface::attr a);
+		virtual void display(void);
+
+		// returns true if the current row has been laid
+		// out with the same key in the previous generation,
+		// then it has to be skipped and it's kept as is
+		bool same_row(const key& k);
+
+		// draws the frame onto b; gen is the last generation
+		// drawn onto b (0 at first) and it's updated, rows
+		// not changed since then are skipped if b keeps them
+		// returns false if b couldn't be initialized
+		bool blit(vbrush::iface* b, uint64_t& gen) const;
+
+		uint64_t gen(void) const {
+			return gen_;
+		}
+	};
+}
+
+#endif //_GRID_H_
+
@@ -0,0 +1,157 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _HASHTEXT_BRUSH_H_
+#define _HASHTEXT_BRUSH_H_
+
+#include <vector>
+#include <cwchar>
+#include "vbrush.h"
+#include "hashtext_fmt.h"
+
+namespace ht_fmt {
+	// builds a whole frame in memory as 'wchar_t'
+	// with '#' escapes, see hashtext_fmt.h; derived
+	// classes only have to implement display(void)
+	// to output frame(); B can be any interface
+	// derived from vbrush::iface
+	template<typename B = vbrush::iface>
+	class basic_brush : public B {
+	protected:
+		std::vector<wchar_t>	buf_;
+
+		void write_attr(const uint32_t attr_mask) {
+			buf_.push_back(L'#');
+			buf_.push_back((wchar_t)attr_mask);
+		}
+
+		void pad(const size_t written, const ssize_t len) {
+			if((len > 0) && ((ssize_t)written < len))
+				buf_.insert(buf_.end(), len - written, L' ');
+		}
+	public:
+		basic_brush() {
+			buf_.reserve(4096);
+		}
+
+		const std::vector<wchar_t>& frame(void) const {
+			return buf_;
+		}
+
+		virtual bool init(void) {
+			buf_.clear();
+			return true;
+		}
+
+		virtual void draw_text(const char* t, const ssize_t len) {
+			// plain chars are widened directly
+			// into the frame buffer
+			size_t	written = 0;
+			for(; *t; ++t, ++written) {
+				buf_.push_back((wchar_t)*t);
+				if('#' == *t)
+					buf_.push_back(L'#');
+			}
+			pad(written, len);
+		}
+
+		virtual void draw_text(const wchar_t* t, const ssize_t len) {
+			size_t		total_written = 0;
+			const wchar_t	*esc = std::wcschr(t, L'#');
+			while(esc) {
+				// copy the whole chunk up to and
+				// including '#', then escape it
+				buf_.insert(buf_.end(), t, esc + 1);
+				buf_.push_back(L'#');
+				total_written += esc - t + 1;
+				t = esc + 1;
+				esc = std::wcschr(t, L'#');
+			}
+			const size_t	sz = std::wcslen(t);
+			buf_.insert(buf_.end(), t, t + sz);
+			total_written += sz;
+			pad(total_written, len);
+		}
+
+		virtual void next_row(const size_t n_rows) {
+			buf_.insert(buf_.end(), n_rows, L'\n');
+		}
+
+		virtual void set_attr_on(const vbrush::iface::attr a) {
+			switch(a) {
+			case vbrush::iface::BOLD: {
+				write_attr(ht_fmt::BOLD_ON);
+			} break;
+			case vbrush::iface::REVERSE: {
+				write_attr(ht_fmt::REVERSE_ON);
+			} break;
+			case vbrush::iface::DIM: {
+				write_attr(ht_fmt::DIM_ON);
+			} break;
+			case vbrush::iface::C_BLUE: {
+				write_attr(ht_fmt::BLUE_ON);
+			} break;
+			case vbrush::iface::C_MAGENTA: {
+				write_attr(ht_fmt::MAGENTA_ON);
+			} break;
+			case vbrush::iface::C_YELLOW: {
+				write_attr(ht_fmt::YELLOW_ON);
+			} break;
+			case vbrush::iface::C_GREEN: {
+				write_attr(ht_fmt::GREEN_ON);
+			} break;
+			default:
+				break;
+			}
+		}
+
+		virtual void set_attr_off(const vbrush::iface::attr a) {
+			switch(a) {
+			case vbrush::iface::BOLD: {
+				write_attr(ht_fmt::BOLD_OFF);
+			} break;
+			case vbrush::iface::REVERSE: {
+				write_attr(ht_fmt::REVERSE_OFF);
+			} break;
+			case vbrush::iface::DIM: {
+				write_attr(ht_fmt::DIM_OFF);
+			} break;
+			case vbrush::iface::C_BLUE: {
+				write_attr(ht_fmt::BLUE_OFF);
+			} break;
+			case vbrush::iface::C_MAGENTA: {
+				write_attr(ht_fmt::MAGENTA_OFF);
+			} break;
+			case vbrush::iface::C_YELLOW: {
+				write_attr(ht_fmt::YELLOW_OFF);
+			} break;
+			case vbrush::iface::C_GREEN: {
+				write_attr(ht_fmt::GREEN_OFF);
+			} break;
+
+			default:
+				break;
+			}
+		}
+
+	};
+
+	typedef basic_brush<>	brush;
+}
+
+#endif //_HASHTEXT_BRUSH_H_
+
@@ -0,0 +1,328 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "huntlog.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <limits>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+	const char	MAGIC[8] = { 'L', 'H', 'H', 'U', 'N', 'T', 'L', 'G' };
+	const uint32_t	VERSION = 1;
+	// how many blocks we allocate every time
+	// the file is full (~2 MiB)
+	const size_t	GROW_BLOCKS = 256;
+
+	int32_t clamp_hp(const float hp) {
+		if(!(hp > 0.0))
+			return 0;
+		if(hp >= (float)std::numeric_limits<int32_t>::max())
+			return std::numeric_limits<int32_t>::max();
+		return (int32_t)hp;
+	}
+
+	template<typename Clock>
+	uint64_t now_ms(void) {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+	}
+}
+
+void huntlog::to_row(const uint64_t ts_ms, const ui::mhw_data& d, row& r) {
+	r.ts_ms = ts_ms;
+	r.state = (d.hunt) ? STATE_HUNT : 0;
+	for(uint32_t i = 0; i < N_PLAYERS; ++i) {
+		r.damage[i] = (d.players[i].used) ? d.players[i].damage : 0;
+		if(d.players[i].used)
+			r.state |= STATE_PLAYER_USED << i;
+	}
+	for(uint32_t i = 0; i < N_MONSTERS; ++i) {
+		r.hp[i] = (d.monsters[i].used) ? clamp_hp(d.monsters[i].hp_current) : -1;
+		if(d.monsters[i].used)
+			r.state |= STATE_MONSTER_USED << i;
+	}
+}
+
+uint8_t* huntlog::recorder::grow(const size_t n_blocks) {
+	const size_t	new_sz = HEADER_SIZE + n_blocks*BLOCK_SIZE;
+	// try to really reserve the space, so that
+	// we don't get SIGBUS when writing to it
+	const int	rv = posix_fallocate(fd_, 0, new_sz);
+	if(rv && ((rv != EOPNOTSUPP) || ftruncate(fd_, new_sz)))
+		throw std::runtime_error((std::string("Can't allocate hunt log file: ") + strerror(rv)).c_str());
+	// a new mapping, the current one is still
+	// written meanwhile; both share the pages
+	void	*p = mmap(0, new_sz, PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+	if(MAP_FAILED == p)
+		throw std::runtime_error((std::string("Can't map hunt log file: ") + strerror(errno)).c_str());
+	return (uint8_t*)p;
+}
+
+void huntlog::recorder::swap_in(uint8_t* p, const size_t n_blocks) {
+	const size_t	cur_idx = (cur_) ? ((uint8_t*)cur_ - base_ - HEADER_SIZE)/BLOCK_SIZE : 0;
+	if(base_)
+		retired_.push_back(std::make_pair(base_, HEADER_SIZE + capacity_*BLOCK_SIZE));
+	base_ = p;
+	hdr_ = (file_header*)base_;
+	if(cur_)
+		cur_ = (block*)(base_ + HEADER_SIZE + cur_idx*BLOCK_SIZE);
+	capacity_ = n_blocks;
+}
+
+void huntlog::recorder::grow_ahead(void) {
+	std::vector<std::pair<uint8_t*, size_t>>	retired;
+	size_t						cap = 0;
+	{
+		std::lock_guard<std::mutex>	lk(grow_mtx_);
+		retired.swap(retired_);
+		cap = (next_base_) ? 0 : capacity_;
+	}
+	for(const auto& r : retired)
+		munmap(r.first, r.second);
+	if(!cap || (4*used_.load() < 3*cap))
+		return;
+	uint8_t	*p = 0;
+	try {
+		p = grow(cap + GROW_BLOCKS);
+	} catch(const std::exception&) {
+		// append will try again and report it
+		return;
+	}
+	std::lock_guard<std::mutex>	lk(grow_mtx_);
+	// append may have grown it meanwhile
+	if(capacity_ >= cap + GROW_BLOCKS) {
+		munmap(p, HEADER_SIZE + (cap + GROW_BLOCKS)*BLOCK_SIZE);
+		return;
+	}
+	next_base_ = p;
+	next_capacity_ = cap + GROW_BLOCKS;
+}
+
+void huntlog::recorder::sync_loop(void) {
+	std::unique_lock<std::mutex>	lk(sync_mtx_);
+	while(sync_run_) {
+		sync_cv_.wait_for(lk, std::chrono::milliseconds(sync_ms_));
+		lk.unlock();
+		// this only needs the fd, hence it's
+		// fine if the mapping is moved meanwhile
+		fdatasync(fd_);
+		grow_ahead();
+		lk.lock();
+	}
+}
+
+huntlog::recorder::recorder(const char* fname, const size_t sync_ms) : fd_(open(fname, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)), base_(0), capacity_(0), hdr_(0), cur_(0), prev_(), used_(0), next_base_(0), next_capacity_(0), wall_base_ms_(now_ms<std::chrono::system_clock>()), steady_base_ms_(now_ms<std::chrono::steady_clock>()), sync_run_(true), sync_ms_(sync_ms) {
+	if(-1 == fd_)
+		throw std::runtime_error((std::string("Can't open hunt log file '") + fname + "': " + strerror(errno)).c_str());
+	try {
+		swap_in(grow(GROW_BLOCKS), GROW_BLOCKS);
+	} catch(...) {
+		close(fd_);
+		throw;
+	}
+	std::memcpy(hdr_->magic, MAGIC, sizeof(MAGIC));
+	hdr_->version = VERSION;
+	hdr_->block_rows = BLOCK_ROWS;
+	hdr_->block_size = BLOCK_SIZE;
+	hdr_->n_blocks = 0;
+	sync_th_ = std::thread(&recorder::sync_loop, this);
+}
+
+huntlog::recorder::~recorder() {
+	{
+		std::lock_guard<std::mutex>	lk(sync_mtx_);
+		sync_run_ = false;
+	}
+	sync_cv_.notify_all();
+	sync_th_.join();
+	// trim the preallocated space we haven't used
+	const size_t	used_sz = HEADER_SIZE + hdr_->n_blocks*BLOCK_SIZE;
+	munmap(base_, HEADER_SIZE + capacity_*BLOCK_SIZE);
+	if(next_base_)
+		munmap(next_base_, HEADER_SIZE + next_capacity_*BLOCK_SIZE);
+	for(const auto& r : retired_)
+		munmap(r.first, r.second);
+	if(ftruncate(fd_, used_sz)) {
+		// nothing we can do, the
+		// file is still readable
+	}
+	fdatasync(fd_);
+	close(fd_);
+}
+
+void huntlog::recorder::append(const row& in) {
+	// blocks have to be sorted by time
+	// for the reader to seek
+	row		r(in);
+	if(cur_ && (r.ts_ms < prev_.ts_ms))
+		r.ts_ms = prev_.ts_ms;
+	// start a new block when the current one is
+	// full or the timestamp can't be delta encoded
+	// (i.e. too far ahead)
+	const bool	new_block = !cur_ || (cur_->hdr.n_rows >= BLOCK_ROWS) ||
+					(r.ts_ms - prev_.ts_ms > std::numeric_limits<uint32_t>::max());
+	if(new_block) {
+		const size_t	idx = hdr_->n_blocks;
+		if(idx >= capacity_) {
+			std::lock_guard<std::mutex>	lk(grow_mtx_);
+			if(next_base_) {
+				swap_in(next_base_, next_capacity_);
+				next_base_ = 0;
+			} else {
+				// the sync thread is behind,
+				// this one has to wait
+				swap_in(grow(capacity_ + GROW_BLOCKS), capacity_ + GROW_BLOCKS);
+			}
+		}
+		cur_ = (block*)(base_ + HEADER_SIZE + idx*BLOCK_SIZE);
+		cur_->hdr.base_ts_ms = r.ts_ms;
+		cur_->hdr.n_rows = 0;
+		std::memcpy(cur_->hdr.base_damage, r.damage, sizeof(r.damage));
+		std::memcpy(cur_->hdr.base_hp, r.hp, sizeof(r.hp));
+		cur_->hdr.base_state = r.state;
+		prev_ = r;
+		hdr_->n_blocks = idx + 1;
+		used_.store(idx + 1);
+		// time to grow ahead
+		if(4*(idx + 1) >= 3*capacity_)
+			sync_cv_.notify_one();
+	}
+	const uint32_t	n = cur_->hdr.n_rows;
+	cur_->ts_delta[n] = r.ts_ms - prev_.ts_ms;
+	for(uint32_t i = 0; i < N_PLAYERS; ++i)
+		cur_->damage_delta[i][n] = r.damage[i] - prev_.damage[i];
+	for(uint32_t i = 0; i < N_MONSTERS; ++i)
+		cur_->hp_delta[i][n] = r.hp[i] - prev_.hp[i];
+	cur_->state[n] = r.state;
+	// commit the row only after
+	// all columns are written
+	cur_->hdr.n_rows = n + 1;
+	prev_ = r;
+}
+
+bool huntlog::reader::cursor::next(huntlog::row& out) {
+	while(blk_ < r_->n_blocks()) {
+		const block	*b = r_->get_block(blk_);
+		if(row_ >= b->hdr.n_rows) {
+			++blk_;
+			row_ = 0;
+			continue;
+		}
+		if(!row_) {
+			cur_.ts_ms = b->hdr.base_ts_ms;
+			std::memcpy(cur_.damage, b->hdr.base_damage, sizeof(cur_.damage));
+			std::memcpy(cur_.hp, b->hdr.base_hp, sizeof(cur_.hp));
+		} else {
+			cur_.ts_ms += b->ts_delta[row_];
+			for(uint32_t i = 0; i < N_PLAYERS; ++i)
+				cur_.damage[i] += b->damage_delta[i][row_];
+			for(uint32_t i = 0; i < N_MONSTERS; ++i)
+				cur_.hp[i] += b->hp_delta[i][row_];
+		}
+		cur_.state = b->state[row_];
+		++row_;
+		out = cur_;
+		return true;
+	}
+	return false;
+}
+
+huntlog::reader::reader(const char* fname) : fd_(open(fname, O_RDONLY)), base_(0), sz_(0), hdr_(0) {
+	if(-1 == fd_)
+		throw std::runtime_error((std::string("Can't open hunt log file '") + fname + "': " + strerror(errno)).c_str());
+	struct stat	st = {0};
+	if(fstat(fd_, &st) || (st.st_size < HEADER_SIZE)) {
+		close(fd_);
+		throw std::runtime_error("Invalid hunt log file (too small)");
+	}
+	sz_ = st.st_size;
+	void	*p = mmap(0, sz_, PROT_READ, MAP_SHARED, fd_, 0);
+	if(MAP_FAILED == p) {
+		close(fd_);
+		throw std::runtime_error((std::string("Can't map hunt log file: ") + strerror(errno)).c_str());
+	}
+	base_ = (const uint8_t*)p;
+	hdr_ = (const file_header*)base_;
+	if(std::memcmp(hdr_->magic, MAGIC, sizeof(MAGIC)) || (hdr_->version != VERSION) || (hdr_->block_rows != BLOCK_ROWS) || (hdr_->block_size != BLOCK_SIZE)) {
+		munmap((void*)base_, sz_);
+		close(fd_);
+		throw std::runtime_error("Invalid hunt log file (wrong header)");
+	}
+	// the file may still be written, hence
+	// only trust what is fully mapped
+	const size_t	n_blocks = std::min((size_t)hdr_->n_blocks, (sz_ - HEADER_SIZE)/BLOCK_SIZE);
+	index_.reserve(n_blocks);
+	for(size_t i = 0; i < n_blocks; ++i)
+		index_.push_back(get_block(i)->hdr.base_ts_ms);
+}
+
+huntlog::reader::~reader() {
+	munmap((void*)base_, sz_);
+	close(fd_);
+}
+
+size_t huntlog::reader::n_rows(void) const {
+	size_t	rv = 0;
+	for(size_t i = 0; i < index_.size(); ++i)
+		rv += get_block(i)->hdr.n_rows;
+	return rv;
+}
+
+uint64_t huntlog::reader::first_ts(void) const {
+	return (index_.empty()) ? 0 : index_[0];
+}
+
+huntlog::reader::cursor huntlog::reader::seek(const uint64_t ts_ms) const {
+	// find the last block starting at or before ts_ms
+	const auto	it = std::upper_bound(index_.begin(), index_.end(), ts_ms);
+	return cursor(this, (it == index_.begin()) ? 0 : (it - index_.begin() - 1));
+}
+
+size_t huntlog::reader::export_csv(std::ostream& ostr, const uint64_t from_ms, const uint64_t to_ms) const {
+	ostr << "ts_ms,hunt";
+	for(uint32_t i = 0; i < N_PLAYERS; ++i)
+		ostr << ",damage_" << i;
+	for(uint32_t i = 0; i < N_MONSTERS; ++i)
+		ostr << ",hp_" << i;
+	ostr << ",state\n";
+	size_t	rv = 0;
+	auto	c = seek(from_ms);
+	row	r;
+	while(c.next(r)) {
+		if(r.ts_ms < from_ms)
+			continue;
+		if(r.ts_ms >= to_ms)
+			break;
+		ostr << r.ts_ms << ',' << ((r.state & STATE_HUNT) ? 1 : 0);
+		for(uint32_t i = 0; i < N_PLAYERS; ++i)
+			ostr << ',' << r.damage[i];
+		for(uint32_t i = 0; i < N_MONSTERS; ++i)
+			ostr << ',' << r.hp[i];
+		ostr << ',' << (uint32_t)r.state << '\n';
+		++rv;
+	}
+	return rv;
+}
+
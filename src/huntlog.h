@@ -0,0 +1,211 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _HUNTLOG_H_
+#define _HUNTLOG_H_
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "ui.h"
+
+// Binary append-only log of samples
+//
+// The file is made of a header page followed by
+// fixed size blocks; each block holds up to BLOCK_ROWS
+// rows stored as columns (timestamp, 4 players damage,
+// 3 monsters HP, state) where each value is the delta
+// from the previous row, and the first row values are
+// in the block header. Being blocks of fixed size, the
+// block headers are also the (sparse) index used to
+// seek by time
+
+namespace huntlog {
+	const uint32_t	BLOCK_ROWS = 240,
+	      		BLOCK_SIZE = 8192,
+			HEADER_SIZE = 4096,
+			N_PLAYERS = 4,
+			N_MONSTERS = 3;
+
+	// state bits
+	const uint8_t	STATE_HUNT = 0x01,
+	      		STATE_PLAYER_USED = 0x02, // shifted by player index
+			STATE_MONSTER_USED = 0x20; // shifted by monster index
+
+	struct file_header {
+		char		magic[8];
+		uint32_t	version,
+				block_rows,
+				block_size,
+				pad;
+		uint64_t	n_blocks;
+	};
+
+	struct block_header {
+		uint64_t	base_ts_ms;
+		uint32_t	n_rows,
+				pad;
+		int32_t		base_damage[N_PLAYERS],
+				base_hp[N_MONSTERS];
+		uint8_t		base_state,
+				pad2[3];
+	};
+
+	struct block {
+		block_header	hdr;
+		uint32_t	ts_delta[BLOCK_ROWS];
+		int32_t		damage_delta[N_PLAYERS][BLOCK_ROWS],
+				hp_delta[N_MONSTERS][BLOCK_ROWS];
+		uint8_t		state[BLOCK_ROWS];
+	};
+
+	static_assert(sizeof(file_header) <= HEADER_SIZE, "huntlog::file_header too large");
+	static_assert(sizeof(block) <= BLOCK_SIZE, "huntlog::block too large for BLOCK_SIZE");
+
+	// ts_ms is wall clock time, HP is
+	// clamped to [0, INT32_MAX] (NaN is 0)
+	struct row {
+		uint64_t	ts_ms;
+		int32_t		damage[N_PLAYERS],
+				hp[N_MONSTERS];
+		uint8_t		state;
+	};
+
+	extern void to_row(const uint64_t ts_ms, const ui::mhw_data& d, row& r);
+
+	// appends rows into a preallocated mmap'd file
+	// a background thread periodically syncs the file
+	// and grows it ahead of time (a new mapping swapped
+	// in by append) so that append never waits on disk
+	class recorder {
+		int			fd_;
+		uint8_t			*base_;
+		size_t			capacity_; // in blocks
+		file_header		*hdr_;
+		block			*cur_;
+		row			prev_;
+		// blocks in use, for the sync thread
+		std::atomic<size_t>	used_;
+		// grown mapping ready to be swapped in, and
+		// the ones swapped out, to be unmapped; all
+		// under grow_mtx_, which is never held while
+		// waiting on disk but by the fallback in append
+		std::mutex		grow_mtx_;
+		uint8_t			*next_base_;
+		size_t			next_capacity_;
+		std::vector<std::pair<uint8_t*, size_t>>	retired_;
+		// wall clock and steady clock at start,
+		// timestamps are the first plus elapsed
+		// time so they never go backwards
+		const uint64_t		wall_base_ms_,
+					steady_base_ms_;
+		// background sync
+		std::thread		sync_th_;
+		std::mutex		sync_mtx_;
+		std::condition_variable	sync_cv_;
+		bool			sync_run_;
+		size_t			sync_ms_;
+
+		recorder(const recorder&) = delete;
+		recorder& operator=(const recorder&) = delete;
+
+		// reserves n_blocks in the file and maps
+		// all of it again, throws on failure
+		uint8_t* grow(const size_t n_blocks);
+
+		// p becomes the current mapping, the previous
+		// one is retired; grow_mtx_ has to be held
+		void swap_in(uint8_t* p, const size_t n_blocks);
+
+		// from the sync thread, when 3/4 are used
+		void grow_ahead(void);
+
+		void sync_loop(void);
+	public:
+		recorder(const char* fname, const size_t sync_ms = 5000);
+
+		~recorder();
+
+		// rows going back in time get
+		// the timestamp of the previous
+		void append(const row& r);
+
+		// steady_ms is from std::chrono::steady_clock
+		void append(const uint64_t steady_ms, const ui::mhw_data& d) {
+			row	r;
+			to_row(wall_base_ms_ + (steady_ms - steady_base_ms_), d, r);
+			append(r);
+		}
+	};
+
+	// reads a log written by recorder
+	class reader {
+		int			fd_;
+		const uint8_t		*base_;
+		size_t			sz_;
+		const file_header	*hdr_;
+		// first timestamp of each block
+		std::vector<uint64_t>	index_;
+
+		reader(const reader&) = delete;
+		reader& operator=(const reader&) = delete;
+
+		const block* get_block(const size_t i) const {
+			return (const block*)(base_ + HEADER_SIZE + i*BLOCK_SIZE);
+		}
+	public:
+		class cursor {
+			const reader	*r_;
+			size_t		blk_,
+					row_;
+			huntlog::row	cur_;
+		public:
+			cursor(const reader* r, const size_t blk) : r_(r), blk_(blk), row_(0), cur_() {
+			}
+
+			// returns false at end of log
+			bool next(huntlog::row& out);
+		};
+
+		reader(const char* fname);
+
+		~reader();
+
+		size_t n_blocks(void) const {
+			return index_.size();
+		}
+
+		size_t n_rows(void) const;
+
+		uint64_t first_ts(void) const;
+
+		// returns a cursor positioned at the beginning
+		// of the block containing ts_ms; rows before
+		// ts_ms still have to be skipped by the caller
+		cursor seek(const uint64_t ts_ms) const;
+
+		// export rows in [from_ms, to_ms) as CSV
+		size_t export_csv(std::ostream& ostr, const uint64_t from_ms, const uint64_t to_ms) const;
+	};
+}
+
+#endif //_HUNTLOG_H_
+
@@ -20,15 +20,40 @@
 #include <getopt.h>
 #include <cstring>
 #include <memory>
+#include <vector>
 #include <csignal>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <limits>
+#include <functional>
+#include <set>
+#include <algorithm>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "memory.h"
 #include "ui.h"
 #include "wdisplay.h"
+#include "adisplay.h"
 #include "fdisplay.h"
+#include "shmdisplay.h"
 #include "events.h"
 #include "timer.h"
 #include "mhw_lookup.h"
 #include "utils.h"
+#include "snapshot.h"
+#include "analytics.h"
+#include "huntlog.h"
+#include "discovery.h"
+#include "stats.h"
+#include "metrics.h"
+#include "trace.h"
+#include "datastream.h"
+#include "gamedb.h"
+#include "push.h"
 
 // Useful links with the SmartHunter sources; note that
 // sir-wilhelm is the one up to date with most recent
@@ -57,25 +82,56 @@ namespace {
 	const char*	VERSION = "0.1.3";
 
 	// settings/options management
-	pid_t		mhw_pid = -1;
+	std::vector<pid_t>	mhw_pids;
 	std::string	save_dir,
 			load_dir,
-			file_display;
+			file_display,
+			shm_display,
+			record_file,
+			export_log_file,
+			metrics_socket,
+			trace_file,
+			headless_out,
+			push_socket,
+			gamedb_file;
 	bool	        show_monsters_data = false,
 			show_crowns_data = false,
+			show_dps_data = false,
 			debug_ptrs = false,
 			debug_all = false,
 			mem_dirty_opt = false,
 			lazy_alloc = true,
 			direct_mem = true,
 			no_color = false,
-			compact_display = false;
-	size_t		refresh_interval = 1000;
+			ansi_display = false,
+			compact_display = false,
+			all_instances = false,
+			show_stats = false,
+			headless = false,
+			delta_stream = false,
+			gamedb_dump = false;
+	size_t		refresh_interval = 1000,
+			sample_interval = 0,
+			tick_budget = 0,
+			mirror_budget = 0;
+	uint64_t	log_from_s = 0,
+			log_to_s = std::numeric_limits<uint64_t>::max()/1000;
+	std::vector<std::pair<mhw_lookup::data_group, size_t>>	group_periods;
+	datastream::format	headless_fmt = datastream::NDJSON;
+	ssize_t		find_near_k = -1;
+	size_t		ptr_scan_addr = 0,
+			ptr_scan_depth = 4;
+	uint32_t	ptr_scan_offset = 0x1000;
+	gamedb::db	game_db;
 
 	void print_help(const char *prog, const char *version) {
 		std::cerr <<	"Usage: " << prog << " [options]\nExecutes linux-hunter " << version << "\n\n"
 				"-m, --show-monsters    Shows HP monsters data (requires slightly more CPU usage)\n"
 				"-c, --show-crowns      Shows information about crowns (Gold Small, Silver Large and Gold Large)\n"
+				"    --show-dps         Shows rolling damage per second of players over the last 5s, 30s, the\n"
+				"                       whole hunt and the peak over 5s\n"
+				"    --stats            Shows how long each stage of a refresh takes (p50/p99/max) and counters\n"
+				"                       of memory reads; also prints a summary on exit\n"
 				"-s, --save dir         Captures the specified pid into directory 'dir' and quits\n"
 				"-l, --load dir         Loads the specified capture directory 'dir' and displays\n"
 				"                       info (static - useful for debugging)\n"
@@ -88,20 +144,64 @@ namespace {
 				"                       and formats (see sources for usage of '#' escape sequances)\n"
 				"                       It is heavily suggested to have file 'f' under '/dev/shm' or '/tmp'\n"
 				"                       memory backed filesystem\n"	
-				"    --mhw-pid p        Specifies which pid to scan memory for (usually main MH:W)\n"
+				"    --shm-display n    Publishes the content of display (same format as -f) and the data it has\n"
+				"                       been drawn from into shared memory segment 'n' (i.e. '/dev/shm/n')\n"
+				"                       Readers can map it once and wait for updates (see shm_reader.cpp)\n"
+				"    --record f         Records all the samples (players' damage, monsters' HP and hunt state)\n"
+				"                       into binary hunt log file 'f'\n"
+				"    --metrics-socket p Serves internal counters and timings in Prometheus text format over\n"
+				"                       unix socket 'p' (i.e. curl --unix-socket p http://localhost/metrics)\n"
+				"    --trace f          Records a timeline of each refresh into file 'f' (Chrome/Perfetto\n"
+				"                       trace-event JSON, open with https://ui.perfetto.dev)\n"
+				"    --push-socket p    Pushes the sampled data to any number of clients over unix socket 'p'\n"
+				"                       (binary, the whole state on connect then field deltas, see push_proto.h)\n"
+				"    --headless fmt     Doesn't draw on the terminal, writes instead one record per refresh of\n"
+				"                       the sampled data on stdout, as 'ndjson' or 'csv'\n"
+				"    --headless-out f   Writes the headless records into file 'f' instead (can be a FIFO)\n"
+				"    --delta            Only writes the fields changed since the previous headless record, and\n"
+				"                       no record at all when nothing has changed\n"
+				"    --export-log f     Exports the hunt log file 'f' as CSV on stdout and quits\n"
+				"    --log-range b:e    When exporting a hunt log, only export samples between 'b' and 'e'\n"
+				"                       seconds from the beginning of the log ('e' can be omitted)\n"
+				"    --mhw-pid p        Specifies which pid to scan memory for (usually main MH:W); can be a\n"
+				"                       comma separated list to follow several instances, shown as tabs\n"
 				"                       When not specified, linux-hunter will try to find it automatically\n"
 				"                       This is default behaviour\n"
+				"    --all-instances    Follows all the running instances of MH:W instead of the first one;\n"
+				"                       -f, --shm-display, --record, --headless-out and --push-socket get\n"
+				"                       a '.n' suffix for each instance 'n' (1, 2, ...)\n"
 				"    --debug-ptrs       Prints the main AoB (Array of Bytes) pointers (useful for debugging)\n"
 				"    --debug-all        Prints all the AoB (Array of Bytes) partial and full matches\n"
 				"                       (useful for analysing AoB) and quits; implies setting debug-ptrs\n"
+				"    --gamedb f         Loads the game database 'f', holding patterns, their locations and\n"
+				"                       offsets of each MH:W build; on a known build no scan is needed\n"
+				"    --gamedb-dump      Prints the database entry of the running MH:W build and quits\n"
+				"    --ptr-scan a:d:o   Prints the pointer paths from the AoB to address 'a' (i.e. 0x7f0012345678)\n"
+				"                       of at most 'd' levels (default 4) each with an offset up to 'o'\n"
+				"                       (default 0x1000) and quits; works with -l,--load too\n"
+				"    --find-near k      Prints the best locations of each AoB allowing up to 'k' different bytes\n"
+				"                       and quits; useful to fix the patterns after a MH:W update. Only the first\n"
+				"                       64 bytes are scanned for, the others are compared on each candidate\n"
 				"    --mem-dirty-opt    Enable optimization to load memory pages just once per refresh;\n"
 				"                       this should be slightly less accurate but uses less system time\n"
 				"    --no-lazy-alloc    Disable optimization to reduce memory usage and always allocates memory\n"
 				"                       to copy MH:W process - minimize dynamic allocations at the expense of\n"
 				"                       memory usage; decrease calls to alloc/free functions\n"
+				"    --mirror-budget m  Limits the local copy of MH:W memory (see --no-direct-mem) to 'm' MB;\n"
+				"                       the least recently read regions are dropped and read again when needed\n"
 				"-r, --refresh i        Specifies what is the UI/stats refresh interval in ms (default 1000)\n"
+				"    --sample i         Specifies the interval in ms at which MH:W memory is read, independently\n"
+				"                       of the UI refresh (default is same as refresh interval)\n"
+				"    --group-period g:i Specifies the refresh interval 'i' in ms for data group 'g', which is one\n"
+				"                       of 'session' (default 5000), 'hunt-status' (default 1000), 'damage'\n"
+				"                       (default 0), 'monster-hp' (default 0) and 'monster-meta' (default 2000);\n"
+				"                       0 means every refresh. Can be specified multiple times\n"
+				"    --tick-budget i    Specifies the max time in ms to spend reading data each refresh; when\n"
+				"                       exceeded, lower priority data groups are postponed (default 0, no limit)\n"
 				"    --no-color         Do not use colours when rendering text (useful on distro which can't\n"
 				"                       handle ncurses properly and end up not displaying text)\n"
+				"    --ansi-display     Draws on the terminal with raw ANSI escape sequences instead of ncurses\n"
+				"                       only updating what has changed (faster on slow/remote terminals)\n"
 				"    --compact-display  Makes the output take up less vertical space by removing unnecessary\n"
 				"                       sections and line breaks. It comes in handy when pairing linux-hunter\n"
 				"                       with vkdto (see https://github.com/Emanem/linux-hunter#vulkan-overlay)\n"
@@ -109,6 +209,7 @@ namespace {
 				"When linux-hunter is running:\n\n"
 				"'q' or 'ESC'           Quits the application\n"
 				"'r'                    Force a refresh\n"
+				"TAB or '1'-'9'         Switches between MH:W instances (see --mhw-pid)\n"
 		<< std::flush;
 	}
 
@@ -117,19 +218,41 @@ namespace {
 		static struct option	long_options[] = {
 			{"help",		no_argument,	   0,	0},
 			{"mhw-pid",		required_argument, 0,   0},
+			{"all-instances",	no_argument,	   0,	0},
 			{"show-monsters",	no_argument,	   0,	'm'},
 			{"show-crowns",	    no_argument,	   0,	'c'},
+			{"show-dps",		no_argument,	   0,	0},
+			{"stats",		no_argument,	   0,	0},
 			{"save",		required_argument, 0,	's'},
 			{"load",		required_argument, 0,	'l'},
 			{"no-direct-mem",	no_argument,	   0,	0},
 			{"f-display",		required_argument, 0,	'f'},
+			{"shm-display",		required_argument, 0,	0},
+			{"record",		required_argument, 0,	0},
+			{"export-log",		required_argument, 0,	0},
+			{"metrics-socket",	required_argument, 0,	0},
+			{"trace",		required_argument, 0,	0},
+			{"push-socket",		required_argument, 0,	0},
+			{"headless",		required_argument, 0,	0},
+			{"headless-out",	required_argument, 0,	0},
+			{"delta",		no_argument,	   0,	0},
+			{"log-range",		required_argument, 0,	0},
 			{"debug-ptrs",		no_argument,	   0,	0},
 			{"debug-all",		no_argument,	   0,	0},
+			{"find-near",		required_argument, 0,	0},
+			{"gamedb",		required_argument, 0,	0},
+			{"ptr-scan",		required_argument, 0,	0},
+			{"gamedb-dump",		no_argument,	   0,	0},
 			{"mem-dirty-opt",	no_argument,	   0,	0},
 			{"no-lazy-alloc",	no_argument,	   0,	0},
+			{"mirror-budget",	required_argument, 0,	0},
 			{"refresh",		required_argument, 0,   'r'},
+			{"sample",		required_argument, 0,   0},
+			{"group-period",	required_argument, 0,   0},
+			{"tick-budget",		required_argument, 0,   0},
 			{"no-color",		no_argument,       0,	0},
 			{"compact-display",	no_argument,       0,	0},
+			{"ansi-display",	no_argument,       0,	0},
 			{0, 0, 0, 0}
 		};
 
@@ -155,15 +278,84 @@ namespace {
 				} else if (!std::strcmp("mem-dirty-opt", long_options[option_index].name)) {
 					mem_dirty_opt = true;
 				} else if (!std::strcmp("mhw-pid", long_options[option_index].name)) {
-					mhw_pid = std::atoi(optarg);
+					const char	*p = optarg;
+					while(p && *p) {
+						mhw_pids.push_back(std::atoi(p));
+						if((p = std::strchr(p, ',')))
+							++p;
+					}
+				} else if (!std::strcmp("all-instances", long_options[option_index].name)) {
+					all_instances = true;
 				} else if (!std::strcmp("no-lazy-alloc", long_options[option_index].name)) {
 					lazy_alloc = false;
+				} else if (!std::strcmp("mirror-budget", long_options[option_index].name)) {
+					mirror_budget = std::atoi(optarg);
 				} else if (!std::strcmp("no-direct-mem", long_options[option_index].name)) {
 					direct_mem = false;
 				} else if (!std::strcmp("no-color", long_options[option_index].name)) {
 					no_color = true;
+				} else if (!std::strcmp("ansi-display", long_options[option_index].name)) {
+					ansi_display = true;
+				} else if (!std::strcmp("show-dps", long_options[option_index].name)) {
+					show_dps_data = true;
+				} else if (!std::strcmp("stats", long_options[option_index].name)) {
+					show_stats = true;
 				} else if (!std::strcmp("compact-display", long_options[option_index].name)) {
 					compact_display = true;
+				} else if (!std::strcmp("group-period", long_options[option_index].name)) {
+					const char		*sep = std::strchr(optarg, ':');
+					mhw_lookup::data_group	g;
+					if(!sep || !mhw_lookup::scheduler::parse_group(std::string(optarg, sep - optarg).c_str(), g))
+						throw std::runtime_error((std::string("Invalid group-period '") + optarg + "'").c_str());
+					group_periods.push_back(std::make_pair(g, (size_t)std::atoi(sep+1)));
+				} else if (!std::strcmp("sample", long_options[option_index].name)) {
+					sample_interval = std::atoi(optarg);
+				} else if (!std::strcmp("shm-display", long_options[option_index].name)) {
+					shm_display = optarg;
+				} else if (!std::strcmp("record", long_options[option_index].name)) {
+					record_file = optarg;
+				} else if (!std::strcmp("export-log", long_options[option_index].name)) {
+					export_log_file = optarg;
+				} else if (!std::strcmp("metrics-socket", long_options[option_index].name)) {
+					metrics_socket = optarg;
+				} else if (!std::strcmp("trace", long_options[option_index].name)) {
+					trace_file = optarg;
+				} else if (!std::strcmp("push-socket", long_options[option_index].name)) {
+					push_socket = optarg;
+				} else if (!std::strcmp("headless", long_options[option_index].name)) {
+					if(!datastream::parse_format(optarg, headless_fmt))
+						throw std::runtime_error((std::string("Invalid headless format '") + optarg + "'").c_str());
+					headless = true;
+				} else if (!std::strcmp("headless-out", long_options[option_index].name)) {
+					headless_out = optarg;
+				} else if (!std::strcmp("delta", long_options[option_index].name)) {
+					delta_stream = true;
+				} else if (!std::strcmp("log-range", long_options[option_index].name)) {
+					const char	*sep = std::strchr(optarg, ':');
+					log_from_s = std::atoll(optarg);
+					if(sep && *(sep+1))
+						log_to_s = std::atoll(sep+1);
+				} else if (!std::strcmp("find-near", long_options[option_index].name)) {
+					find_near_k = std::atoi(optarg);
+					if(find_near_k < 0)
+						throw std::runtime_error("Option --find-near needs a non negative number of mismatches");
+				} else if (!std::strcmp("ptr-scan", long_options[option_index].name)) {
+					char	*sep = 0;
+					ptr_scan_addr = std::strtoull(optarg, &sep, 0);
+					if(*sep == ':')
+						ptr_scan_depth = std::strtoul(sep+1, &sep, 0);
+					uint64_t	offset = ptr_scan_offset;
+					if(*sep == ':')
+						offset = std::strtoull(sep+1, &sep, 0);
+					if(*sep || !ptr_scan_addr || !ptr_scan_depth || (offset > std::numeric_limits<uint32_t>::max()))
+						throw std::runtime_error((std::string("Invalid pointer scan '") + optarg + "'").c_str());
+					ptr_scan_offset = offset;
+				} else if (!std::strcmp("gamedb", long_options[option_index].name)) {
+					gamedb_file = optarg;
+				} else if (!std::strcmp("gamedb-dump", long_options[option_index].name)) {
+					gamedb_dump = true;
+				} else if (!std::strcmp("tick-budget", long_options[option_index].name)) {
+					tick_budget = std::atoi(optarg);
 				}
 			} break;
 
@@ -208,38 +400,521 @@ namespace {
 }
 
 namespace {
-	class keyb_proc : public events::fd_proc {
-		bool&	run_;
-	public:
-		keyb_proc(bool& r) : events::fd_proc(STDIN_FILENO), run_(r) {
-		}
-
-		virtual bool on_data(const char* p, const size_t sz) const {
-			for(size_t i = 0; i < sz; ++i) {
-				switch(p[i]) {
-				case 27: // ESC key
-				case 'q':
-					run_ = false;
-					return true;
-				case 'r':
-					return true;
-				default:
-					break;
+	void 			(*prev_sigint_handler)(int) = 0;
+	std::atomic<bool>	run(true);
+	// readable once we have to quit, to
+	// wake up threads waiting on events
+	int			stop_fd = -1;
+	std::mutex		run_mtx;
+	std::condition_variable	run_cv;
+
+	void sigint_handler(int signal) {
+		run = false;
+		// reset to previous handler
+		if(prev_sigint_handler)
+			std::signal(SIGINT, prev_sigint_handler);
+	}
+
+	// wakes up all the threads waiting
+	// in wait_until
+	void stop_all(void) {
+		{
+			std::lock_guard<std::mutex>	lk(run_mtx);
+			run = false;
+		}
+		run_cv.notify_all();
+		const uint64_t	one = 1;
+		if(-1 != stop_fd && sizeof(one) != write(stop_fd, &one, sizeof(one)))
+			std::cerr << "Can't signal stop" << std::endl;
+	}
+
+	// returns true if we have to perform a refresh,
+	// tab is the MH:W instance being displayed
+	bool on_keys(const char* p, const size_t sz, const size_t n_tabs, size_t& tab) {
+		bool	rv = false;
+		for(size_t i = 0; i < sz; ++i) {
+			switch(p[i]) {
+			case 27: // ESC key
+			case 'q':
+				stop_all();
+				return true;
+			case 'r':
+				return true;
+			case '\t':
+				tab = (tab + 1) % n_tabs;
+				rv = true;
+				break;
+			default:
+				if(p[i] >= '1' && p[i] <= '9' && (size_t)(p[i] - '1') < n_tabs) {
+					tab = p[i] - '1';
+					rv = true;
 				}
+				break;
 			}
+		}
 
-			return false;
+		return rv;
+	}
+
+	// returns false if we have to quit
+	bool wait_until(const std::chrono::steady_clock::time_point& tp) {
+		trace::scope			ts("wait");
+		std::unique_lock<std::mutex>	lk(run_mtx);
+		return !run_cv.wait_until(lk, tp, []() -> bool { return !run; });
+	}
+
+	typedef snapshot::latest<snapshot::mhw_sample>	sample_channel;
+
+	// how often to look for a new MH:W
+	// instance once it has exited, when
+	// we can't be notified
+	const size_t	REATTACH_MS = 5000;
+
+	// how many times to look for the patterns
+	// when MH:W has just been started
+	const size_t	STARTUP_RETRIES = 12;
+
+	// pids followed by some instance, two
+	// instances never follow the same one
+	std::mutex		claims_mtx;
+	std::set<pid_t>		claimed_pids;
+
+	bool claim_pid(const pid_t pid) {
+		std::lock_guard<std::mutex>	lk(claims_mtx);
+		return claimed_pids.insert(pid).second;
+	}
+
+	void release_pid(const pid_t pid) {
+		std::lock_guard<std::mutex>	lk(claims_mtx);
+		claimed_pids.erase(pid);
+	}
+
+	// as utils::try_find_mhw_pid, skipping
+	// the pids already followed
+	bool try_find_free_pid(pid_t& pid) {
+		std::vector<pid_t>		pids;
+		utils::find_mhw_pids(pids);
+		std::lock_guard<std::mutex>	lk(claims_mtx);
+		for(const auto& p : pids) {
+			if(!claimed_pids.count(p)) {
+				pid = p;
+				return true;
+			}
 		}
+		return false;
+	}
+
+	// MH:W lookup patterns, in the order
+	// they are scanned for
+	enum pattern_id {
+		P_PLAYER_NAME = 0,
+		P_CURRENT_PLAYER_NAME,
+		P_PLAYER_DAMAGE,
+		P_MONSTER,
+		P_PLAYER_BUFF,
+		P_EMETTA,
+		P_PLAYER_NAME_LINUX,
+		P_LOBBY_STATUS,
+		N_PATTERNS
 	};
 
-	void 	(*prev_sigint_handler)(int) = 0;
-	bool	run(true);
+	// a MH:W process being followed: its memory
+	// mirror, patterns, scheduler and sinks; these
+	// are only used by its own threads
+	struct instance {
+		const size_t				idx;
+		memory::browser				mb;
+		// to follow a new process
+		// once this one exits
+		discovery::watcher			dw;
+		// copies of the patterns
+		// compiled only once
+		const std::vector<memory::pattern>&	compiled;
+		std::vector<memory::pattern>		pats;
+		// of the game build, if in game_db
+		const gamedb::entry			*build;
+		gamedb::offsets_table			offs;
+		std::vector<memory::pattern*>		p_vec,
+							reloc;
+		mhw_lookup::pattern_data		pd;
+		mhw_lookup::scheduler			s;
+		sample_channel				w_chan,
+							f_chan,
+							sh_chan;
+		std::vector<sample_channel*>		chans;
+		std::unique_ptr<vbrush::iface>		f_dpy;
+		std::unique_ptr<shmdisplay::iface>	s_dpy;
+		std::unique_ptr<huntlog::recorder>	rec;
+		std::unique_ptr<datastream::writer>	ds;
+		std::unique_ptr<push::server>		ps;
+		std::thread				s_th,
+							f_th,
+							sh_th;
+		std::exception_ptr			s_ex,
+							f_ex,
+							sh_ex;
 
-	void sigint_handler(int signal) {
-		run = false;
-		// reset to previous handler
-		if(prev_sigint_handler)
-			std::signal(SIGINT, prev_sigint_handler);
+		instance(const size_t i, const pid_t pid, const std::vector<memory::pattern>& compiled) : idx(i), mb(pid, mem_dirty_opt, lazy_alloc, direct_mem, mirror_budget*1024*1024), compiled(compiled), pats(compiled), build(0), pd{ &pats[P_PLAYER_NAME_LINUX], &pats[P_PLAYER_DAMAGE], (show_monsters_data) ? &pats[P_MONSTER] : 0, &pats[P_LOBBY_STATUS], &offs }, s(tick_budget) {
+			for(auto& p : pats)
+				p_vec.push_back(&p);
+			// patterns to look for again
+			// when MH:W is restarted
+			reloc = { &pats[P_PLAYER_NAME_LINUX], &pats[P_PLAYER_DAMAGE], &pats[P_LOBBY_STATUS] };
+			if(show_monsters_data)
+				reloc.push_back(&pats[P_MONSTER]);
+			for(const auto& gp : group_periods)
+				s.set_period(gp.first, gp.second);
+		}
+	};
+
+	// sets patterns, locations and offsets from
+	// the game_db entry of the build in is attached
+	// to; returns false when the build is unknown
+	bool apply_gamedb(instance& in) {
+		if(game_db.empty() || (-1 == in.mb.pid()))
+			return false;
+		uint64_t		fp = 0;
+		size_t			base = 0;
+		const gamedb::entry	*e = (gamedb::fingerprint(in.mb.pid(), fp, base)) ? game_db.find(fp) : 0;
+		// back to the built-in values first,
+		// the vector keeps its storage
+		if(e != in.build) {
+			in.pats = in.compiled;
+			in.offs = (e) ? e->offs : gamedb::offsets_table();
+			in.build = e;
+		}
+		if(!e)
+			return false;
+		e->apply(base, &in.p_vec[0], &in.p_vec[0] + in.p_vec.size());
+		return true;
+	}
+
+	// sinks of each instance get a '.n' suffix
+	// when following more than one
+	std::string sink_name(const std::string& name, const size_t idx, const size_t n) {
+		return (n > 1) ? name + "." + std::to_string(idx + 1) : name;
+	}
+
+	// blocks until MH:W is started, returns
+	// false if we have been interrupted
+	bool wait_for_mhw(discovery::watcher& dw, pid_t& pid) {
+		while(run) {
+			// without the proc connector
+			// look for it once in a while
+			if(-1 == dw.fd()) {
+				if(utils::try_find_mhw_pid(pid))
+					return true;
+				poll(0, 0, REATTACH_MS);
+				continue;
+			}
+			struct pollfd	pfd = { dw.fd(), POLLIN, 0 };
+			if(0 > poll(&pfd, 1, -1)) {
+				if(EINTR == errno)
+					continue;
+				throw std::runtime_error((std::string("Error in poll: ") + strerror(errno)).c_str());
+			}
+			std::vector<pid_t>	pids;
+			if(dw.read(pids)) {
+				pid = pids[0];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// reads MH:W memory of in every interval_ms (this
+	// doesn't depend on how long it takes to display
+	// data), lays out the frame once and publishes the
+	// latest sample on every channel; when reattach is
+	// set and MH:W exits, waits for a new instance (see
+	// dw) and follows it, re-using the patterns in
+	// reloc where possible
+	void sampler_run(instance& in, const size_t n_instances, const bool reattach, const size_t interval_ms, const size_t draw_flags) {
+		memory::browser&			mb = in.mb;
+		discovery::watcher&			dw = in.dw;
+		const mhw_lookup::pattern_data&		pd = in.pd;
+		std::vector<memory::pattern*>&		reloc = in.reloc;
+		mhw_lookup::scheduler&			s = in.s;
+		const std::vector<sample_channel*>&	chans = in.chans;
+		huntlog::recorder			*rec = in.rec.get();
+		datastream::writer			*ds = in.ds.get();
+		push::server				*ps = in.ps.get();
+		try {
+			trace::thread_name("sampler");
+			snapshot::mhw_sample	cur;
+			analytics::dps_tracker	dps;
+			events::reactor		rt;
+			bool			waiting = false;
+			uint64_t		last_attach_ms = 0;
+			size_t			resident = 0;
+			auto			now_ms = [](void) -> uint64_t {
+				return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			};
+			// MH:W has been started but we couldn't
+			// attach to it yet, it may be loading
+			pid_t				pending = -1;
+			std::function<void(void)>	on_exit;
+			auto				try_attach = [&](const pid_t pid) {
+				pending = -1;
+				if(!utils::is_mhw_pid(pid))
+					return;
+				// another instance may
+				// follow it already
+				if((pid != mb.pid()) && !claim_pid(pid))
+					return;
+				try {
+					mb.attach(pid);
+					apply_gamedb(in);
+					mb.relocate_patterns(&reloc[0], &reloc[0] + reloc.size());
+				} catch(const std::exception&) {
+					// it may have exited already
+					release_pid(pid);
+					return;
+				}
+				if((-1 == pd.player->mem_location) || (-1 == pd.damage->mem_location) || (pd.monster && (-1 == pd.monster->mem_location))) {
+					pending = pid;
+					return;
+				}
+				if(-1 != dw.fd()) {
+					rt.remove_fd(dw.fd());
+					dw.listen(false);
+				}
+				if(-1 != mb.pidfd())
+					rt.add_fd(mb.pidfd(), EPOLLIN, [&](const uint32_t ev) { on_exit(); });
+				cur.data.waiting = waiting = false;
+			};
+			on_exit = [&](void) {
+				release_pid(mb.pid());
+				if(-1 != mb.pidfd())
+					rt.remove_fd(mb.pidfd());
+				cur.data = ui::mhw_data();
+				cur.data.waiting = true;
+				s.reset();
+				waiting = true;
+				last_attach_ms = now_ms();
+				// get notified as soon as
+				// MH:W is started again
+				dw.listen(true);
+				if(-1 != dw.fd()) {
+					rt.add_fd(dw.fd(), EPOLLIN, [&](const uint32_t ev) {
+						// the first one not followed by
+						// other instances yet; these get
+						// the same events
+						std::vector<pid_t>	pids;
+						if(!dw.read(pids))
+							return;
+						for(const auto& pid : pids) {
+							try_attach(pid);
+							if(!waiting || (-1 != pending))
+								return;
+						}
+						// all taken, there may be one
+						// reported in an earlier batch
+						pid_t	pid = -1;
+						if(try_find_free_pid(pid))
+							try_attach(pid);
+					});
+				}
+			};
+			if(reattach && (-1 != mb.pidfd()))
+				rt.add_fd(mb.pidfd(), EPOLLIN, [&](const uint32_t ev) { on_exit(); });
+			// only to wake up on stop_all()
+			rt.add_fd(stop_fd, EPOLLIN, [](const uint32_t ev) {});
+			auto			sample = [&](void) {
+				if(waiting) {
+					timer::thread_tmr	tt(&cur.tm);
+					// without the proc connector
+					// we have to look for it
+					pid_t	pid = pending;
+					if((now_ms() - last_attach_ms >= REATTACH_MS) && ((-1 != pid) || ((-1 == dw.fd()) && try_find_free_pid(pid)))) {
+						try_attach(pid);
+						last_attach_ms = now_ms();
+					}
+					if(waiting)
+						return;
+				}
+				try {
+					timer::thread_tmr	tt(&cur.tm);
+					mb.update();
+					stats::scope		sc(stats::LOOKUP);
+					mhw_lookup::get_data(pd, mb, cur.data, s);
+				} catch(const std::exception&) {
+					// MH:W may have exited before
+					// we've been notified
+					if(!reattach || mb.alive())
+						throw;
+					on_exit();
+				}
+			};
+			// ticks are on absolute
+			// deadlines, we don't drift
+			rt.set_tick(interval_ms, [&](const uint64_t n_ticks) {
+				stats::scope	sc(stats::TICK),
+						sc_cpu(stats::TICK_CPU, CLOCK_THREAD_CPUTIME_ID);
+				sample();
+				// summed over all the instances
+				const size_t	res = mb.resident();
+				stats::add(stats::MIRROR_BYTES, res - resident);
+				resident = res;
+				++cur.seq;
+				cur.ts_ms = now_ms();
+				dps.update(cur.ts_ms, cur.data);
+				if(rec)
+					rec->append(cur.ts_ms, cur.data);
+				if(ds)
+					ds->append(cur.ts_ms, cur.data);
+				if(ps)
+					ps->publish(cur.data, cur.ts_ms);
+				// headless, nothing to draw
+				if(chans.empty())
+					return;
+				const ui::app_data	ad{ VERSION, cur.tm, in.idx, n_instances, (int)mb.pid() };
+				{
+					stats::scope	sc(stats::LAYOUT);
+					ui::draw(&cur.view, draw_flags, ad, cur.data, no_color, compact_display);
+				}
+				for(auto& c : chans) {
+					c->back() = cur;
+					c->publish();
+				}
+			});
+			// clients are served from this
+			// thread, right after each sample
+			if(ps) {
+				rt.add_fd(ps->fd(), EPOLLIN, [&](const uint32_t ev) {
+					const int	cfd = ps->accept();
+					if(-1 == cfd)
+						return;
+					rt.add_fd(cfd, push::server::EVENTS, [&, cfd](const uint32_t ev) {
+						if(ps->serve(cfd))
+							return;
+						rt.remove_fd(cfd);
+						ps->drop(cfd);
+					});
+				});
+			}
+			while(run)
+				rt.run_once();
+		} catch(...) {
+			in.s_ex = std::current_exception();
+			stop_all();
+		}
+	}
+
+	// draws the latest sample every interval_ms
+	// on a vbrush::iface; shm is the same display
+	// when it also has to publish the data
+	void renderer_run(vbrush::iface* dpy, shmdisplay::iface* shm, const stats::stage st, sample_channel& c, const size_t interval_ms, std::exception_ptr& ex) {
+		try {
+			trace::thread_name(stats::name(st));
+			uint64_t	gen = 0;
+			auto		next_tp = std::chrono::steady_clock::now();
+			while(run) {
+				if(c.update()) {
+					stats::scope	sc(st);
+					if(shm)
+						shm->set_data(c.front().data, c.front().ts_ms);
+					c.front().view.blit(dpy, gen);
+				}
+				next_tp += std::chrono::milliseconds(interval_ms);
+				const auto	now = std::chrono::steady_clock::now();
+				if(next_tp < now)
+					next_tp = now;
+				if(!wait_until(next_tp))
+					break;
+			}
+		} catch(...) {
+			ex = std::current_exception();
+			stop_all();
+		}
+	}
+}
+
+namespace {
+	// snap is false when the memory content
+	// has been loaded already
+	void scan_instance(instance& in, const bool snap, const bool just_started) {
+		memory::browser&	mb = in.mb;
+		if(snap && !debug_all && apply_gamedb(in)) {
+			// only the patterns in use which aren't
+			// where expected are scanned for
+			const size_t	n = mb.relocate_patterns(&in.reloc[0], &in.reloc[0] + in.reloc.size());
+			std::fprintf(stderr, "Known MH:W build '%s' in pid %d, %lu patterns scanned for\n", in.build->name.c_str(), (int)mb.pid(), n);
+		} else {
+			if(snap)
+				mb.snap();
+			mb.find_patterns(&in.p_vec[0], &in.p_vec[0] + in.p_vec.size(), debug_all);
+		}
+		// MH:W may still be loading when
+		// it has just been started
+		for(size_t i = 0; just_started && (i < STARTUP_RETRIES) && run && ((-1 == in.pd.player->mem_location) || (-1 == in.pd.damage->mem_location)); ++i) {
+			poll(0, 0, REATTACH_MS);
+			mb.snap();
+			mb.find_patterns(&in.p_vec[0], &in.p_vec[0] + in.p_vec.size(), debug_all);
+		}
+	}
+
+	// prints the candidates of p as patterns ready to
+	// be pasted, with mismatching bytes marked
+	void print_near(memory::browser& mb, const memory::pattern& p, const std::vector<memory::near_match>& v) {
+		std::vector<int>	expected;
+		for(const auto& m : p.matches) {
+			if(expected.size() < m.tgt_offset + m.length)
+				expected.resize(m.tgt_offset + m.length, -1);
+			for(size_t i = 0; i < m.length; ++i)
+				expected[m.tgt_offset + i] = p.bytes[m.src_offset + i];
+		}
+		std::fprintf(stderr, "%s\n", p.name.c_str());
+		if(v.empty())
+			std::fprintf(stderr, "\tno candidates\n");
+		for(const auto& n : v) {
+			std::string	bytes,
+					diff;
+			for(size_t i = 0; i < expected.size(); ++i) {
+				char	buf[4];
+				uint8_t	c = 0;
+				if(expected[i] < 0) {
+					std::snprintf(buf, 4, "?? ");
+				} else if(!mb.safe_read_mem(n.addr + i, c)) {
+					std::snprintf(buf, 4, "-- ");
+				} else {
+					std::snprintf(buf, 4, "%02X ", c);
+					if(c != expected[i])
+						diff += " " + std::to_string(i);
+				}
+				bytes += buf;
+			}
+			std::fprintf(stderr, "\t0x%016lX\t%2lu\t0x%016lX %s\n\t\t%s\n", n.addr, n.mismatches, n.target, (n.valid) ? "ok" : "invalid", bytes.c_str());
+			if(!diff.empty())
+				std::fprintf(stderr, "\t\tdiffers at:%s\n", diff.c_str());
+		}
+	}
+
+	// the instances are scanned by a pool of
+	// at most one thread per core
+	void scan_all(std::vector<std::unique_ptr<instance>>& ins, const bool snap, const bool just_started) {
+		std::atomic<size_t>		next(0);
+		std::vector<std::exception_ptr>	ex(ins.size());
+		auto				worker = [&](void) {
+			for(size_t i = next++; i < ins.size(); i = next++) {
+				try {
+					scan_instance(*ins[i], snap, just_started);
+				} catch(...) {
+					ex[i] = std::current_exception();
+				}
+			}
+		};
+		const size_t			n_threads = std::min<size_t>(ins.size(), std::max(1U, std::thread::hardware_concurrency()));
+		std::vector<std::thread>	th;
+		for(size_t i = 1; i < n_threads; ++i)
+			th.push_back(std::thread(worker));
+		worker();
+		for(auto& t : th)
+			t.join();
+		for(const auto& e : ex) {
+			if(e)
+				std::rethrow_exception(e);
+		}
 	}
 }
 
@@ -247,102 +922,412 @@ int main(int argc, char *argv[]) {
 	try {
 		// initialize sigint
 		prev_sigint_handler = std::signal(SIGINT, sigint_handler);
-		// lookup patterns
-		memory::pattern	p0(patterns::PlayerName),
-				p1(patterns::CurrentPlayerName),
-				p2(patterns::PlayerDamage),
-				p3(patterns::Monster),
-				p4(patterns::PlayerBuff),
-				p5(patterns::Emetta),
-				p6(patterns::PlayerNameLinux),
-				p7(patterns::LobbyStatus);
-		memory::pattern	*p_vec[] = { &p0, &p1, &p2, &p3, &p4 , &p5, &p6, &p7 };
 		// parse args first
 		const auto optind = parse_args(argc, argv, argv[0], VERSION);
+		// before any thread is started
+		if(show_stats || !metrics_socket.empty())
+			stats::enable();
+		// export hunt log and quit, this
+		// doesn't need MH:W at all
+		if(!export_log_file.empty()) {
+			huntlog::reader	hr(export_log_file.c_str());
+			const uint64_t	b_ts = hr.first_ts();
+			const uint64_t	e_ts = (log_to_s < (std::numeric_limits<uint64_t>::max() - b_ts)/1000) ? b_ts + log_to_s*1000 : std::numeric_limits<uint64_t>::max();
+			const size_t	n = hr.export_csv(std::cout, b_ts + log_from_s*1000, e_ts);
+			std::cerr << "Exported " << n << " samples" << std::endl;
+			return 0;
+		}
 		// check come consistency
 		if(!load_dir.empty() && !save_dir.empty())
 			throw std::runtime_error("Can't specify both 'load' and 'save' options");
-		// if we aren't in load mode and mhw pid is -1
-		// try to find it automatically
-		if(-1 == mhw_pid && load_dir.empty()) {
-			mhw_pid = utils::find_mhw_pid();
-			std::cerr << "Found pid: " << mhw_pid << std::endl;
+		if((mhw_pids.size() > 1 || all_instances) && (!load_dir.empty() || !save_dir.empty()))
+			throw std::runtime_error("Options 'load' and 'save' only work with one MH:W instance");
+		// if we aren't in load mode and no pid has been
+		// set try to find it automatically, or wait for it
+		discovery::watcher	dw;
+		bool			just_started = false;
+		if(mhw_pids.empty() && load_dir.empty()) {
+			// listen first, so that we
+			// don't miss it
+			dw.listen(true);
+			pid_t	pid = -1;
+			if(all_instances)
+				utils::find_mhw_pids(mhw_pids);
+			else if(utils::try_find_mhw_pid(pid))
+				mhw_pids.push_back(pid);
+			if(mhw_pids.empty()) {
+				std::cerr << "Waiting for MH:W to start..." << std::endl;
+				if(!wait_for_mhw(dw, pid))
+					return 0;
+				mhw_pids.push_back(pid);
+				just_started = true;
+			}
+			dw.listen(false);
+			for(const auto& p : mhw_pids)
+				std::cerr << "Found pid: " << p << std::endl;
+		}
+		// load mode
+		if(mhw_pids.empty())
+			mhw_pids.push_back(-1);
+		for(const auto& p : mhw_pids) {
+			if(!claim_pid(p))
+				throw std::runtime_error((std::string("MH:W pid ") + std::to_string(p) + " specified more than once").c_str());
 		}
+		if(headless && headless_out.empty() && (mhw_pids.size() > 1))
+			throw std::runtime_error("Option --headless needs --headless-out with more than one MH:W instance");
+		// lookup patterns, compiled once
+		// and copied by each instance
+		const std::vector<memory::pattern>	compiled{
+			memory::pattern(patterns::PlayerName),
+			memory::pattern(patterns::CurrentPlayerName),
+			memory::pattern(patterns::PlayerDamage),
+			memory::pattern(patterns::Monster),
+			memory::pattern(patterns::PlayerBuff),
+			memory::pattern(patterns::Emetta),
+			memory::pattern(patterns::PlayerNameLinux),
+			memory::pattern(patterns::LobbyStatus)
+		};
+		static_assert(N_PATTERNS == 8, "pattern_id doesn't match the compiled patterns");
 		// start here...
-		memory::browser	mb(mhw_pid, mem_dirty_opt, lazy_alloc, direct_mem);
+		std::vector<std::unique_ptr<instance>>	ins;
+		for(size_t i = 0; i < mhw_pids.size(); ++i)
+			ins.push_back(std::unique_ptr<instance>(new instance(i, mhw_pids[i], compiled)));
 		// if we're in load mode fill b
 		// with content from the disk
 		if(!load_dir.empty()) {
 			if(direct_mem)
 				throw std::runtime_error("The option -l,--load is incompatible with direct memory, please specify also --no-direct-mem");
 			std::cerr << "Loading memory content from directory '" << load_dir << "'..." << std::endl;
-			mb.load(load_dir.c_str());
+			ins[0]->mb.load(load_dir.c_str());
 			std::cerr << "done" << std::endl;
-		} else {
-			mb.snap();
+		} else if(!save_dir.empty()) {
 			// if in save mode, save and exit
-			if(!save_dir.empty()) {
-				std::cerr << "Saving memory content to directory '" << save_dir << "'..." << std::endl;
-				mb.store(save_dir.c_str());
-				std::cerr << "done" << std::endl;
-				return 0;
-			}
+			ins[0]->mb.snap();
+			std::cerr << "Saving memory content to directory '" << save_dir << "'..." << std::endl;
+			ins[0]->mb.store(save_dir.c_str());
+			std::cerr << "done" << std::endl;
+			return 0;
+		}
+		if(!gamedb_file.empty())
+			game_db.load(gamedb_file.c_str());
+		// approximate search of the patterns
+		// in the first instance, and quit
+		if(find_near_k >= 0) {
+			if(!load_dir.empty())
+				throw std::runtime_error("Option --find-near needs a running MH:W");
+			const size_t				MAX_OUT = 10;
+			auto&					p_vec = ins[0]->p_vec;
+			std::vector<std::vector<memory::near_match>>	out;
+			std::cerr << "Finding AoB with up to " << find_near_k << " mismatches..." << std::endl;
+			// chunks are read live by find_near,
+			// there is no need to mirror all
+			ins[0]->mb.snap_regions();
+			ins[0]->mb.find_near(&p_vec[0], &p_vec[0] + p_vec.size(), find_near_k, MAX_OUT, std::max(1U, std::thread::hardware_concurrency()), out);
+			std::fprintf(stderr, "%-18s\t%s\t%-18s\n", "address", "mm", "target");
+			for(size_t i = 0; i < p_vec.size(); ++i)
+				print_near(ins[0]->mb, *p_vec[i], out[i]);
+			return 0;
 		}
 		// print out basic patterns
 		std::cerr << "Finding main AoB entry points..." << std::endl;
-		mb.find_patterns(&p_vec[0], &p_vec[sizeof(p_vec)/sizeof(p_vec[0])], debug_all);
+		scan_all(ins, load_dir.empty(), just_started);
 		if(debug_ptrs) {
 			/*
 			 * This code is used to ensure the read_mem was
 			 * actually working... seems to be :-)
 			 */
-			for(const auto& p : p_vec) {
-				std::ostringstream	ostr;
-				if(p->mem_location > 0) {
-					const uint64_t	u64 = mb.read_mem<uint64_t>(p->mem_location);
-					print_bin(u64, ostr);
+			for(const auto& in : ins) {
+				if(ins.size() > 1)
+					std::fprintf(stderr, "pid %d\n", (int)in->mb.pid());
+				for(const auto& p : in->p_vec) {
+					std::ostringstream	ostr;
+					if(p->mem_location > 0) {
+						const uint64_t	u64 = in->mb.read_mem<uint64_t>(p->mem_location);
+						print_bin(u64, ostr);
+					}
+					std::fprintf(stderr, "%-16s\t%16li\t%s\n", p->name.c_str(), p->mem_location, ostr.str().c_str());
 				}
-				std::fprintf(stderr, "%-16s\t%16li\t%s\n", p->name.c_str(), p->mem_location, ostr.str().c_str());
 			}
 		}
 		std::cerr << "Done" << std::endl;
+		// entry of the first instance build
+		if(gamedb_dump) {
+			uint64_t	fp = 0;
+			size_t		base = 0;
+			if(!gamedb::fingerprint(ins[0]->mb.pid(), fp, base))
+				throw std::runtime_error(("Can't find the MH:W executable image in pid " + std::to_string(ins[0]->mb.pid())).c_str());
+			gamedb::dump(std::cout, fp, base, &ins[0]->p_vec[0], &ins[0]->p_vec[0] + ins[0]->p_vec.size(), ins[0]->offs);
+			return 0;
+		}
+		// pointer paths from the patterns of
+		// the first instance, and quit
+		if(ptr_scan_addr) {
+			const size_t			MAX_OUT = 100;
+			auto&				in = *ins[0];
+			std::vector<size_t>		roots;
+			std::vector<std::string>	names;
+			for(const auto& p : in.p_vec) {
+				size_t	r = 0;
+				if((-1 == p->mem_location) || !in.mb.safe_load_effective_addr_rel(p->mem_location, r))
+					continue;
+				roots.push_back(r);
+				names.push_back(p->name);
+			}
+			if(roots.empty())
+				throw std::runtime_error("Can't find any AoB to start the pointer paths from");
+			// the content of all regions is
+			// needed, not just of the patterns
+			if(load_dir.empty())
+				in.mb.snap();
+			std::fprintf(stderr, "Finding pointer paths to 0x%lX (%lu levels, offsets up to 0x%X)...\n", ptr_scan_addr, ptr_scan_depth, ptr_scan_offset);
+			std::vector<memory::pointer_path>	paths;
+			in.mb.find_pointer_paths(ptr_scan_addr, roots, ptr_scan_depth, ptr_scan_offset, MAX_OUT, std::max(1U, std::thread::hardware_concurrency()), paths);
+			std::fprintf(stderr, "Found %lu\n", paths.size());
+			for(const auto& pp : paths) {
+				const size_t	i = std::find(roots.begin(), roots.end(), pp.root) - roots.begin();
+				std::printf("%-18s\t0x%016lX\t{ ", names[i].c_str(), pp.root);
+				for(size_t j = 0; j < pp.offsets.size(); ++j)
+					std::printf("%s0x%X", (j) ? ", " : "", pp.offsets[j]);
+				std::printf(" }\n");
+			}
+			return 0;
+		}
 		// quit at this stage in case we have set the flag debug-all
 		if(debug_all)
 			return 0;
-		if((-1 == p6.mem_location) || (-1 == p2.mem_location))
-			throw std::runtime_error("Can't find AoB for patterns::PlayerNameLinux and/or patterns::PlayerDamage - Try to run with 'sudo' and/or specify a pid");
-		if(show_monsters_data && (-1 == p3.mem_location))
-			throw std::runtime_error("Can't find AoB for patterns::Monster");
+		for(const auto& in : ins) {
+			const std::string	pid_info = (ins.size() > 1) ? " in pid " + std::to_string(in->mb.pid()) : "";
+			if((-1 == in->pd.player->mem_location) || (-1 == in->pd.damage->mem_location))
+				throw std::runtime_error(("Can't find AoB for patterns::PlayerNameLinux and/or patterns::PlayerDamage" + pid_info + " - Try to run with 'sudo' and/or specify a pid").c_str());
+			if(show_monsters_data && (-1 == in->pd.monster->mem_location))
+				throw std::runtime_error(("Can't find AoB for patterns::Monster" + pid_info).c_str());
+		}
 		// main loop
-		std::unique_ptr<vbrush::iface>	w_dpy(wdisplay::get()),
-						f_dpy((file_display.empty()) ? 0 : fdisplay::get(file_display.c_str()));
-		ui::app_data			ad{ VERSION, timer::cpu_ms()};
-		ui::mhw_data			mhwd;
+		std::unique_ptr<vbrush::iface>	w_dpy((headless) ? 0 : (ansi_display) ? adisplay::get() : wdisplay::get());
 		size_t				draw_flags = 0;
 		if(show_monsters_data)
 			draw_flags |= ui::draw_flags::SHOW_MONSTER_DATA;
 		if (show_crowns_data)
 			draw_flags |= ui::draw_flags::SHOW_CROWN_DATA;
-		mhw_lookup::pattern_data	mhwpd{ &p6, &p2, (show_monsters_data) ? &p3 : 0, &p7 };
-		keyb_proc			kp(run);
-		// if we don't perform clear, the lazy_alloc
-		// option would be rendered useless because
-		// the memory::browser recycles memory and if
-		// we were not to clear it, we would keep it
-		// even with lazy allocations
-		if(lazy_alloc)
-			mb.clear();
-		while(run) {
-			timer::thread_tmr	tt(&ad.tm);
-			mb.update();
-			mhw_lookup::get_data(mhwpd, mb, mhwd);
-			ui::draw(w_dpy.get(), draw_flags, ad, mhwd, no_color, compact_display);
-			if(f_dpy) ui::draw(f_dpy.get(), draw_flags, ad, mhwd, no_color, compact_display);
-			size_t			cur_refresh_tm = 0;
-			do {
-				const auto 	tm_get = tt.get_wall();
-				cur_refresh_tm = (refresh_interval > tm_get) ? (refresh_interval-tm_get) : 0;
-			} while(!kp.do_io(cur_refresh_tm));
+		if(show_dps_data)
+			draw_flags |= ui::draw_flags::SHOW_DPS_DATA;
+		if(show_stats)
+			draw_flags |= ui::draw_flags::SHOW_STATS;
+		for(auto& in : ins) {
+			const size_t	n = ins.size();
+			if(!file_display.empty())
+				in->f_dpy.reset(fdisplay::get(sink_name(file_display, in->idx, n).c_str()));
+			if(!shm_display.empty())
+				in->s_dpy.reset(shmdisplay::get(sink_name(shm_display, in->idx, n).c_str()));
+			// if we don't perform clear, the lazy_alloc
+			// option would be rendered useless because
+			// the memory::browser recycles memory and if
+			// we were not to clear it, we would keep it
+			// even with lazy allocations
+			if(lazy_alloc)
+				in->mb.clear();
+			// each renderer gets its own channel
+			// from the sampler thread
+			if(w_dpy)
+				in->chans.push_back(&in->w_chan);
+			if(in->f_dpy)
+				in->chans.push_back(&in->f_chan);
+			if(in->s_dpy)
+				in->chans.push_back(&in->sh_chan);
+		}
+		// ncurses/terminal, keyboard input and
+		// signals stay on the main thread; signals
+		// have to be set before starting any thread
+		events::reactor			rt;
+		uint64_t			w_gen = 0;
+		// instance on the terminal
+		size_t				w_tab = 0;
+		auto				refresh = [&](void) {
+			if(!w_dpy)
+				return;
+			stats::scope	sc(stats::DISPLAY);
+			sample_channel&	w_chan = ins[w_tab]->w_chan;
+			w_chan.update();
+			w_chan.front().view.blit(w_dpy.get(), w_gen);
+		};
+		stop_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+		if(-1 == stop_fd)
+			throw std::runtime_error((std::string("Can't create eventfd: ") + strerror(errno)).c_str());
+		rt.add_fd(stop_fd, EPOLLIN, [](const uint32_t ev) {});
+		rt.set_signals({ SIGINT, SIGTERM, SIGWINCH }, [&](const int signo) {
+			if(SIGWINCH != signo) {
+				stop_all();
+				return;
+			}
+			w_gen = 0;
+			refresh();
+		});
+		// a closed reader of the headless
+		// stream is reported by write
+		if(headless) {
+			std::signal(SIGPIPE, SIG_IGN);
+		} else {
+			rt.add_fd(STDIN_FILENO, EPOLLIN|EPOLLPRI|EPOLLERR, [&](const uint32_t ev) {
+				char		buf[128];
+				const ssize_t	rb = read(STDIN_FILENO, buf, sizeof(buf));
+				if(rb < 0) {
+					if(EINTR == errno || EAGAIN == errno)
+						return;
+					throw std::runtime_error((std::string("Error in reading stdin: ") + strerror(errno)).c_str());
+				}
+				// stdin has been closed, we
+				// can only quit with signals
+				if(!rb) {
+					rt.remove_fd(STDIN_FILENO);
+					return;
+				}
+				if(on_keys(buf, rb, ins.size(), w_tab)) {
+					w_gen = 0;
+					refresh();
+				}
+			});
+		}
+		// served from this thread, scrapes
+		// never block the sampler
+		std::unique_ptr<metrics::server>	ms((metrics_socket.empty()) ? 0 : new metrics::server(metrics_socket.c_str(), [&](std::string& out) {
+			metrics::write_stats(out);
+			// summed over all the instances
+			size_t	runs[mhw_lookup::N_GROUPS] = {0},
+				skips[mhw_lookup::N_GROUPS] = {0};
+			for(const auto& in : ins) {
+				for(int i = 0; i < mhw_lookup::N_GROUPS; ++i) {
+					runs[i] += in->s.get_group((mhw_lookup::data_group)i).runs;
+					skips[i] += in->s.get_group((mhw_lookup::data_group)i).skips;
+				}
+			}
+			metrics::header(out, "linux_hunter_group_runs_total", "counter", "Data group refreshes");
+			for(int i = 0; i < mhw_lookup::N_GROUPS; ++i)
+				metrics::sample(out, "linux_hunter_group_runs_total", (std::string("group=\"") + mhw_lookup::scheduler::group_name((mhw_lookup::data_group)i) + "\"").c_str(), runs[i]);
+			metrics::header(out, "linux_hunter_group_skips_total", "counter", "Data group refreshes postponed because of --tick-budget");
+			for(int i = 0; i < mhw_lookup::N_GROUPS; ++i)
+				metrics::sample(out, "linux_hunter_group_skips_total", (std::string("group=\"") + mhw_lookup::scheduler::group_name((mhw_lookup::data_group)i) + "\"").c_str(), skips[i]);
+			const auto&	js = rt.jitter();
+			metrics::header(out, "linux_hunter_refresh_ticks_total", "counter", "UI refresh ticks");
+			metrics::sample(out, "linux_hunter_refresh_ticks_total", 0, js.ticks);
+			metrics::header(out, "linux_hunter_refresh_missed_ticks_total", "counter", "UI refresh ticks missed");
+			metrics::sample(out, "linux_hunter_refresh_missed_ticks_total", 0, js.missed);
+			metrics::header(out, "linux_hunter_refresh_jitter_max_seconds", "gauge", "Max delay of UI refresh ticks");
+			metrics::sample(out, "linux_hunter_refresh_jitter_max_seconds", 0, js.max_us/1e6);
+		}));
+		if(ms) {
+			rt.add_fd(ms->fd(), EPOLLIN, [&](const uint32_t ev) {
+				const int	cfd = ms->accept();
+				if(-1 == cfd)
+					return;
+				rt.add_fd(cfd, metrics::server::EVENTS, [&, cfd](const uint32_t ev) {
+					if(ms->serve(cfd))
+						return;
+					rt.remove_fd(cfd);
+					ms->drop(cfd);
+				});
+			});
+		}
+		std::vector<int>	idle;
+		auto			reap = [&](void) {
+			if(!ms)
+				return;
+			idle.clear();
+			ms->reap(idle);
+			for(const auto& cfd : idle) {
+				rt.remove_fd(cfd);
+				ms->drop(cfd);
+			}
+		};
+		// idle scrapers are dropped on the
+		// refresh tick, or on their own one
+		if(w_dpy) {
+			rt.set_tick(refresh_interval, [&](const uint64_t n_ticks) {
+				refresh();
+				reap();
+			});
+		} else if(ms) {
+			rt.set_tick(metrics::server::IDLE_MS/4, [&](const uint64_t n_ticks) {
+				reap();
+			});
+		}
+		// after the signals have been set, the trace
+		// is flushed once all threads are done
+		if(!trace_file.empty()) {
+			trace::start(trace_file.c_str());
+			trace::thread_name("main");
+		}
+		struct trace_stop {
+			~trace_stop() {
+				trace::stop();
+			}
+		}				ts_stop;
+		// all the sinks first, so that a bad
+		// one is reported before any thread
+		for(auto& in : ins) {
+			const size_t	n = ins.size();
+			if(!record_file.empty())
+				in->rec.reset(new huntlog::recorder(sink_name(record_file, in->idx, n).c_str()));
+			if(headless)
+				in->ds.reset(new datastream::writer(headless_out.empty() ? 0 : sink_name(headless_out, in->idx, n).c_str(), headless_fmt, delta_stream));
+			if(!push_socket.empty())
+				in->ps.reset(new push::server(sink_name(push_socket, in->idx, n).c_str()));
+		}
+		// the loop below can throw too, threads are
+		// stopped and joined on the way out anyway
+		struct threads_join {
+			std::vector<std::unique_ptr<instance>>&	ins;
+
+			void join(void) {
+				stop_all();
+				for(auto& in : ins) {
+					if(in->s_th.joinable())
+						in->s_th.join();
+					if(in->f_th.joinable())
+						in->f_th.join();
+					if(in->sh_th.joinable())
+						in->sh_th.join();
+				}
+			}
+
+			~threads_join() {
+				join();
+			}
+		}				th_join{ ins };
+		for(auto& in : ins) {
+			in->s_th = std::thread(sampler_run, std::ref(*in), ins.size(), load_dir.empty(), (sample_interval) ? sample_interval : refresh_interval, draw_flags);
+			if(in->f_dpy)
+				in->f_th = std::thread(renderer_run, in->f_dpy.get(), (shmdisplay::iface*)0, stats::F_DISPLAY, std::ref(in->f_chan), refresh_interval, std::ref(in->f_ex));
+			if(in->s_dpy)
+				in->sh_th = std::thread(renderer_run, in->s_dpy.get(), in->s_dpy.get(), stats::SHM_DISPLAY, std::ref(in->sh_chan), refresh_interval, std::ref(in->sh_ex));
+		}
+		refresh();
+		while(run)
+			rt.run_once();
+		th_join.join();
+		// close the terminal display
+		// before printing out anything
+		w_dpy.reset();
+		const auto&	js = rt.jitter();
+		if(js.ticks)
+			std::cerr << "Refresh ticks: " << js.ticks << ", " << js.missed << " missed, jitter " << js.sum_us/js.ticks << " usec on average, " << js.max_us << " usec max" << std::endl;
+		for(const auto& in : ins) {
+			if(direct_mem)
+				break;
+			const auto&	mb = in->mb;
+			const auto&	ps = mb.pool_stats();
+			if(ins.size() > 1)
+				std::cerr << "[pid " << mb.pid() << "] ";
+			std::cerr << "Region buffers: " << ps.mmaps << " mmap, " << ps.munmaps << " munmap, " << ps.reuses << " reused, " << mb.resident()/(1024*1024) << " MiB resident, " << ps.peak/(1024*1024) << " MiB peak, " << mb.evictions() << " evicted" << std::endl;
+		}
+		if(show_stats)
+			stats::print(std::cerr);
+		for(const auto& in : ins) {
+			if(in->s_ex)
+				std::rethrow_exception(in->s_ex);
+			if(in->f_ex)
+				std::rethrow_exception(in->f_ex);
+			if(in->sh_ex)
+				std::rethrow_exception(in->sh_ex);
 		}
 	} catch(const std::exception& e) {
 		std::cerr << "Exception: " << e.what() << std::endl;
@@ -16,18 +16,57 @@
  * */
 
 #include "memory.h"
+#include "stats.h"
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <algorithm>
 #include <cstring>
+#include <climits>
 #include <limits>
+#include <atomic>
+#include <thread>
+#include <functional>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <sys/uio.h>
 #include <iconv.h>
 #include <limits>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// from linux/fs.h, kernel 6.11+
+#ifndef PROCMAP_QUERY
+struct procmap_query {
+	uint64_t	size;
+	uint64_t	query_flags;
+	uint64_t	query_addr;
+	uint64_t	vma_start;
+	uint64_t	vma_end;
+	uint64_t	vma_flags;
+	uint64_t	vma_page_size;
+	uint64_t	vma_offset;
+	uint64_t	inode;
+	uint32_t	dev_major;
+	uint32_t	dev_minor;
+	uint32_t	vma_name_size;
+	uint32_t	build_id_size;
+	uint64_t	vma_name_addr;
+	uint64_t	build_id_addr;
+};
+
+#define PROCMAP_QUERY_VMA_READABLE	0x01
+#define PROCMAP_QUERY			_IOWR('f', 17, struct procmap_query)
+#endif
 
 memory::pattern::pattern() : mem_location(-1) {
 }
@@ -79,8 +118,73 @@ void memory::pattern::print(std::ostream& ostr) {
 	}
 }
 
-void memory::browser::snap_mem_regions(std::vector<mem_region>& mr, const bool alloc_mem) {
-	mr.clear();
+namespace {
+	// 64 bit FNV-1a
+	uint64_t fingerprint(const char* p, const size_t sz) {
+		uint64_t	h = 0xcbf29ce484222325UL;
+		for(size_t i = 0; i < sz; ++i) {
+			h ^= (uint8_t)p[i];
+			h *= 0x100000001b3UL;
+		}
+		return h;
+	}
+
+	uint64_t parse_hex(const char*& p, const char* e) {
+		uint64_t	rv = 0;
+		for(; p < e; ++p) {
+			const char	c = *p;
+			if(c >= '0' && c <= '9') rv = (rv << 4) | (c - '0');
+			else if(c >= 'a' && c <= 'f') rv = (rv << 4) | (c - 'a' + 10);
+			else if(c >= 'A' && c <= 'F') rv = (rv << 4) | (c - 'A' + 10);
+			else break;
+		}
+		return rv;
+	}
+
+	size_t fetch_len(const struct iovec* iov, const size_t n) {
+		size_t	rv = 0;
+		for(size_t i = 0; i < n; ++i)
+			rv += iov[i].iov_len;
+		return rv;
+	}
+
+	void skip_field(const char*& p, const char* e) {
+		while(p < e && *p != ' ') ++p;
+		while(p < e && *p == ' ') ++p;
+	}
+}
+
+bool memory::browser::read_maps(void) {
+	stats::scope	sc(stats::MAPS);
+	stats::add(stats::MAPS_READS);
+	if(-1 == maps_fd_) {
+		const std::string	maps_name = std::string("/proc/") + std::to_string(pid_) + "/maps";
+		maps_fd_ = open(maps_name.c_str(), O_RDONLY|O_CLOEXEC);
+		if(-1 == maps_fd_)
+			throw std::runtime_error("Can't open /proc/.../maps");
+	}
+	if(maps_buf_.empty())
+		maps_buf_.resize(256*1024);
+	// read it all from the beginning, the
+	// buffer only grows and is then reused
+	size_t	sz = 0;
+	while(true) {
+		if(sz == maps_buf_.size())
+			maps_buf_.resize(maps_buf_.size()*2);
+		const ssize_t	rb = pread(maps_fd_, &maps_buf_[sz], maps_buf_.size() - sz, sz);
+		if(rb < 0) {
+			if(EINTR == errno)
+				continue;
+			throw std::runtime_error("Can't read /proc/.../maps");
+		}
+		if(!rb)
+			break;
+		sz += rb;
+	}
+	const uint64_t	fp = fingerprint(&maps_buf_[0], sz) ^ sz;
+	if(fp == maps_fp_)
+		return false;
+	maps_fp_ = fp;
 	/* example :
 	* 5662e000-56a21000 r-xp 00000000 08:16 29098197                           /home/ema/.steam/ubuntu12_32/steam
 	* 56a21000-56a36000 r--p 003f3000 08:16 29098197                           /home/ema/.steam/ubuntu12_32/steam
@@ -90,60 +194,84 @@ void memory::browser::snap_mem_regions(std::vector<mem_region>& mr, const bool a
 	* cbbfd000-cbbfe000 ---p 00000000 00:00 0 
 	* 
 	* */
-	const std::string	maps_name = std::string("/proc/") + std::to_string(pid_) + "/maps";
-	std::ifstream		istr(maps_name.c_str());
-	if(!istr)
-		throw std::runtime_error("Can't open /proc/.../maps");
-	std::string line;
-	while(std::getline(istr, line)) {
-		uint64_t	beg = 0,
-				end = 0,
-				offset = 0,
-				inode = 0;
-		char		permissions[32],
-				device[32];
-		const auto rv = std::sscanf(line.c_str(), "%lx-%lx %s %lx %s %li", &beg, &end, permissions, &offset, device, &inode);
-		if(rv == 6 && !inode && permissions[0] == 'r')
-			mr.push_back(mem_region(beg, end, line, alloc_mem));
+	maps_entries_.clear();
+	const char	*p = &maps_buf_[0],
+			*e = p + sz;
+	while(p < e) {
+		const char	*line = p,
+				*eol = (const char*)std::memchr(p, '\n', e - p);
+		if(!eol)
+			eol = e;
+		p = eol + 1;
+		const char	*f = line;
+		const uint64_t	beg = parse_hex(f, eol);
+		if(f >= eol || *f != '-')
+			continue;
+		++f;
+		const uint64_t	end = parse_hex(f, eol);
+		while(f < eol && *f == ' ') ++f;
+		// only anonymous readable regions
+		if(f >= eol || *f != 'r')
+			continue;
+		skip_field(f, eol);	// permissions
+		skip_field(f, eol);	// offset
+		skip_field(f, eol);	// device
+		if(f >= eol || *f != '0' || ((f + 1 < eol) && (f[1] >= '0' && f[1] <= '9')))
+			continue;
+		maps_entries_.push_back(map_entry{ beg, end, (size_t)(line - &maps_buf_[0]), (size_t)(eol - line) });
 	}
+	return true;
+}
+
+void memory::browser::snap_mem_regions(std::vector<mem_region>& mr, const bool alloc_mem) {
+	mr.clear();
+	maps_fp_ = 0;
+	query_misses_.clear();
+	read_maps();
+	for(const auto& i : maps_entries_)
+		mr.push_back(mem_region(i.beg, i.end, std::string(&maps_buf_[i.line], i.line_len), &pool_, alloc_mem));
 }
 
 void memory::browser::snap_pid(void) {
 	if(pid_ < 0)
 		throw std::runtime_error((std::string("Can't snap invalid pid (" + std::to_string(pid_) + ")")).c_str());
 
-	snap_mem_regions(all_regions_, true);
+	// with a budget regions are only
+	// read when needed, see find_first
+	snap_mem_regions(all_regions_, !mirror_budget_);
 	for(auto& v : all_regions_) {
-		const ssize_t		sz = v.end - v.beg;
-		const struct iovec	local = { (void*)v.data, (size_t)sz },
-					remote = { (void*)v.beg, (size_t)sz };
-		const auto		rv = process_vm_readv(pid_, &local, 1, &remote, 1, 0);
-		if(-1 >= rv) {
-			std::cerr << "Region: " << v.debug_info << " Error with process_vm_readv (" << std::to_string(errno) << " " << strerror(errno) << ")" << std::endl;
-			v.data_sz = -1;
+		if(!v.data)
 			continue;
-		}
-		if(sz != rv) {
-			std::cerr << "Region: " << v.debug_info << "coudln't be fully read: " << sz << " vs " << rv << std::endl;
-			v.data_sz = rv;
-		}
-		v.dirty = false;
+		const ssize_t	sz = v.end - v.beg;
+		refresh_region(v);
+		if((v.data_sz >= 0) && (sz != v.data_sz))
+			std::cerr << "Region: " << v.debug_info << "coudln't be fully read: " << sz << " vs " << v.data_sz << std::endl;
 	}
 }
 
 void memory::browser::update_regions(void) {
 	if(-1 == pid_)
 		return;
-	std::vector<mem_region>	new_regions;
-	new_regions.reserve(all_regions_.size()*2);
-	// get them w/o allocating memory
-	snap_mem_regions(new_regions, false);
+	trace::scope	ts("update_regions");
+	query_misses_.clear();
+	// most of the times nothing has
+	// changed, then we're done; regions
+	// found by query_region weren't in the
+	// maps with this same fingerprint, so
+	// they're gone by now
+	if(!read_maps()) {
+		all_regions_.erase(std::remove_if(all_regions_.begin(), all_regions_.end(), [this](const mem_region& r) -> bool { return r.query_fp && (r.query_fp == maps_fp_); }), all_regions_.end());
+		return;
+	}
+	std::vector<mem_region>&	new_regions = tmp_regions_;
+	new_regions.clear();
+	new_regions.reserve(maps_entries_.size());
 	// then merge the current into new (if possible)
 	// regions are supposed to be sorted, so that
 	// below algorithm should be O(N) instead of
 	// O(N^2)
 	size_t hint = 0;
-	for(auto& r : new_regions) {
+	for(const auto& e : maps_entries_) {
 		// lookup the same in the current regions
 		// using the hint
 		size_t	idx = 0;
@@ -151,24 +279,86 @@ void memory::browser::update_regions(void) {
 			mem_region&	cur_r = all_regions_[idx];
 			// if we have match 'move' the region
 			// content
-			if((cur_r.beg == r.beg) && (cur_r.end == r.end)) {
-				r = std::move(cur_r);
+			if((cur_r.beg == e.beg) && (cur_r.end == e.end)) {
+				cur_r.query_fp = 0;
+				new_regions.push_back(std::move(cur_r));
 				hint = idx+1;
 				break;
 			}
 		}
-		// if we don't have 'data' member initilized
-		// allocate memory - this is expensive
-		// hopefully doesn't happen frequently
-		if(!lazy_alloc_ && !r.data) {
-			r.data = (uint8_t*)std::malloc(r.end-r.beg);
-			if(!r.data)
-				throw std::runtime_error((std::string("Can't allocate mem_region (") + std::to_string(r.beg) + "," + std::to_string(r.end) + ")").c_str());
-			r.dirty = true;
-		}
+		// only new regions need the line
+		if(idx == all_regions_.size())
+			new_regions.push_back(mem_region(e.beg, e.end, std::string(&maps_buf_[e.line], e.line_len), &pool_, false));
 	}
-	// finally, swap vectors
+	// regions which are gone give their buffers
+	// back first, so that regions which just moved
+	// or got resized can reuse those right away
+	for(auto& r : all_regions_)
+		r.release();
+	// if we don't have 'data' member initilized
+	// allocate memory - the pool should make this
+	// cheap in most cases
+	if(!lazy_alloc_ && !mirror_budget_) {
+		for(auto& r : new_regions)
+			r.alloc();
+	}
+	// finally, swap vectors, the old
+	// one is kept for the next time
 	all_regions_.swap(new_regions);
+	new_regions.clear();
+}
+
+memory::browser::mem_region* memory::browser::find_region(const size_t addr) {
+	// regions are sorted and don't
+	// overlap, see verify_regions
+	auto	it = std::upper_bound(all_regions_.begin(), all_regions_.end(), addr, [](const size_t a, const mem_region& r) -> bool { return a < r.beg; });
+	if(it != all_regions_.begin()) {
+		--it;
+		if(addr < it->end)
+			return &*it;
+	}
+	// misses are remembered until the next
+	// refresh, the kernel is asked only once
+	const size_t	pg = addr >> PG_SHIFT;
+	auto		it_m = std::lower_bound(query_misses_.begin(), query_misses_.end(), pg);
+	if((it_m != query_misses_.end()) && (*it_m == pg))
+		return 0;
+	mem_region	*r = query_region(addr);
+	if(!r)
+		query_misses_.insert(it_m, pg);
+	return r;
+}
+
+memory::browser::mem_region* memory::browser::query_region(const size_t addr) {
+	if((pid_ < 0) || !procmap_query_ || (-1 == maps_fd_))
+		return 0;
+	struct procmap_query	q;
+	std::memset(&q, 0, sizeof(q));
+	q.size = sizeof(q);
+	q.query_flags = PROCMAP_QUERY_VMA_READABLE;
+	q.query_addr = addr;
+	if(ioctl(maps_fd_, PROCMAP_QUERY, &q)) {
+		// older kernel, don't try again
+		if(ENOTTY == errno || EINVAL == errno)
+			procmap_query_ = false;
+		return 0;
+	}
+	// same filter as read_maps
+	if(q.inode || (addr < q.vma_start) || (addr >= q.vma_end))
+		return 0;
+	char	buf[64];
+	std::snprintf(buf, sizeof(buf), "%lx-%lx (PROCMAP_QUERY)", (unsigned long)q.vma_start, (unsigned long)q.vma_end);
+	auto	it = std::upper_bound(all_regions_.begin(), all_regions_.end(), (size_t)q.vma_start, [](const size_t a, const mem_region& r) -> bool { return a < r.beg; });
+	// it must not overlap, else /proc/<pid>/maps
+	// will be merged on next update anyway
+	if((it != all_regions_.end()) && (it->beg < q.vma_end))
+		return 0;
+	if((it != all_regions_.begin()) && ((it-1)->end > q.vma_start))
+		return 0;
+	// pages are read by the caller
+	it = all_regions_.insert(it, mem_region(q.vma_start, q.vma_end, buf, &pool_, false));
+	it->query_fp = maps_fp_;
+	return &*it;
 }
 
 ssize_t memory::browser::find_once(const pattern& p, const uint8_t* buf, const size_t sz, pbyte& hint, const bool debug_all) const {
@@ -226,37 +416,117 @@ void memory::browser::verify_regions(void) {
 void memory::browser::refresh_region(mem_region& r) {
 	if(pid_ < 0)
 		return;
-	// usually this code is only going to be
-	// invoked when lazy_alloc is set - and
-	// of course data is 'dirty'
-	if(!r.data) {
-		r.data = (uint8_t*)std::malloc(r.end-r.beg);
-		if(!r.data)
-			throw std::runtime_error((std::string("Can't allocate mem_region (") + std::to_string(r.beg) + "," + std::to_string(r.end) + ")").c_str());
-		r.dirty = true;
-	}
-	if(dirty_opt_ && !r.dirty)
+	const size_t	sz = r.end - r.beg;
+	if(fetch(r, 0, sz, true)) {
+		r.data_sz = sz;
 		return;
+	}
+	// only what has been read from
+	// the beginning can be used
+	size_t	p = 0;
+	while(((p << PG_SHIFT) < sz) && r.page_valid(p))
+		++p;
+	r.data_sz = (p) ? (ssize_t)std::min(sz, p << PG_SHIFT) : -1;
+}
 
-	const ssize_t		sz = r.end - r.beg;
-	const struct iovec	local = { (void*)r.data, (size_t)sz },
-				remote = { (void*)r.beg, (size_t)sz };
-	const auto		rv = process_vm_readv(pid_, &local, 1, &remote, 1, 0);
-	if(-1 >= rv) {
-		std::cerr << "Region: " << r.debug_info << " Error with process_vm_readv (" << std::to_string(errno) << " " << strerror(errno) << ")" << std::endl;
-		r.data_sz = -1;
-		return;
+bool memory::browser::fetch(mem_region& r, const size_t off, const size_t len, const bool refresh) {
+	const size_t	sz = r.end - r.beg;
+	if(off + len > sz)
+		return false;
+	// static content, i.e. loaded
+	// from disk, nothing to read
+	if(pid_ < 0)
+		return r.data && ((ssize_t)(off + len) <= r.data_sz);
+	if(!r.data)
+		make_room(r);
+	r.alloc();
+	// update() has been invoked since
+	// last read, all pages are stale
+	if(r.dirty) {
+		std::fill(r.valid.begin(), r.valid.end(), 0);
+		r.dirty = false;
+	}
+	const bool	reread = refresh && !dirty_opt_;
+	const size_t	p_beg = off >> PG_SHIFT,
+			p_end = (off + len + PG_SIZE - 1) >> PG_SHIFT;
+	// merge adjacent missing pages
+	iov_local_.clear();
+	iov_remote_.clear();
+	for(size_t p = p_beg; p < p_end; ) {
+		if(!reread && r.page_valid(p)) {
+			++p;
+			continue;
+		}
+		size_t	q = p + 1;
+		while((q < p_end) && (reread || !r.page_valid(q)))
+			++q;
+		const size_t	o = p << PG_SHIFT,
+				l = std::min(q << PG_SHIFT, sz) - o;
+		iov_local_.push_back(iovec{ (void*)(r.data + o), l });
+		iov_remote_.push_back(iovec{ (void*)(r.beg + o), l });
+		p = q;
+	}
+	for(size_t i = 0; i < iov_local_.size(); i += IOV_MAX) {
+		const size_t	n = std::min(iov_local_.size() - i, (size_t)IOV_MAX);
+		ssize_t		rv = -1;
+		{
+			stats::scope	sc(stats::READ);
+			rv = process_vm_readv(pid_, &iov_local_[i], n, &iov_remote_[i], n, 0);
+		}
+		stats::add(stats::READ_CALLS);
+		if(rv > 0)
+			stats::add(stats::READ_BYTES, rv);
+		if(rv < 0 || (size_t)rv != fetch_len(&iov_local_[i], n))
+			stats::add(stats::READ_FAILURES);
+		if(-1 >= rv)
+			std::cerr << "Region: " << r.debug_info << " Error with process_vm_readv (" << std::to_string(errno) << " " << strerror(errno) << ")" << std::endl;
+		// a short read stops at the first
+		// page which couldn't be read
+		size_t	got = (rv > 0) ? rv : 0;
+		for(size_t j = i; j < i + n; ++j) {
+			const size_t	o = (uint8_t*)iov_local_[j].iov_base - r.data,
+					l = iov_local_[j].iov_len,
+					done = std::min(got, l);
+			for(size_t p = o >> PG_SHIFT; p < ((o + l + PG_SIZE - 1) >> PG_SHIFT); ++p)
+				r.set_page(p, (done == l) || (((p + 1) << PG_SHIFT) <= o + done));
+			got -= done;
+		}
 	}
-	if(sz != rv) {
-		r.data_sz = rv;
+	for(size_t p = p_beg; p < p_end; ++p) {
+		if(!r.page_valid(p))
+			return false;
+	}
+	return true;
+}
+
+void memory::browser::make_room(const mem_region& r) {
+	if(!mirror_budget_)
+		return;
+	const size_t	need = buffer_pool::class_size(r.end - r.beg);
+	while(resident() + need > mirror_budget_) {
+		mem_region	*lru = 0;
+		for(auto& v : all_regions_) {
+			if(v.data && (&v != &r) && (!lru || v.last_used < lru->last_used))
+				lru = &v;
+		}
+		// r alone is larger than the budget
+		if(!lru)
+			break;
+		lru->release();
+		++evictions_;
+		stats::add(stats::EVICTIONS);
 	}
-	r.dirty = false;
 }
 
 ssize_t memory::browser::find_first(const pattern& p, const bool debug_all, const size_t start_addr) {
-	for(const auto& v : all_regions_) {
+	for(auto& v : all_regions_) {
 		if(v.end <= start_addr)
 			continue;
+		if(!v.data)
+			refresh_region(v);
+		if(!v.data || v.data_sz <= 0)
+			continue;
+		v.last_used = ++use_clock_;
 		const uint8_t	*p_buf = v.data,
 				*p_hint = 0;
 		size_t		p_size = v.data_sz;
@@ -274,21 +544,468 @@ ssize_t memory::browser::find_first(const pattern& p, const bool debug_all, cons
 	return -1;
 }
 
+namespace {
+	// runs f(t) on n threads, t in [0, n)
+	void run_on(const size_t n, const std::function<void(const size_t)>& f) {
+		std::vector<std::thread>	th;
+		for(size_t t = 1; t < n; ++t)
+			th.push_back(std::thread(f, t));
+		f(0);
+		for(auto& t : th)
+			t.join();
+	}
+
+	// Shift-And with k mismatches (Bitap), all
+	// the positions are in one word; r_[j] has
+	// bit i set when the first i+1 bytes match
+	// with at most j mismatches. Only the first
+	// 64 bytes are scanned for, the fixed ones
+	// past those are compared on each candidate
+	class bitap {
+		uint64_t		masks_[256],
+					hi_;
+		size_t			len_,
+					full_len_;
+		std::vector<uint64_t>	r_;
+		// offset and value of the bytes
+		// past the first 64
+		std::vector<std::pair<size_t, uint8_t>>	tail_;
+	public:
+		bitap(const memory::pattern& p, const size_t k) : hi_(0), len_(0), full_len_(0), r_(k+1, 0) {
+			if(!p.matches.empty())
+				full_len_ = p.matches.rbegin()->tgt_offset + p.matches.rbegin()->length;
+			len_ = std::min((size_t)64, full_len_);
+			// wildcards match anything
+			const uint64_t	all = (len_ == 64) ? ~0UL : (1UL << len_) - 1;
+			for(auto& m : masks_)
+				m = all;
+			for(const auto& m : p.matches) {
+				for(size_t i = 0; i < m.length; ++i) {
+					if((m.tgt_offset + i) >= len_) {
+						tail_.push_back(std::make_pair(m.tgt_offset + i, p.bytes[m.src_offset + i]));
+						continue;
+					}
+					const uint64_t	bit = 1UL << (m.tgt_offset + i);
+					for(size_t c = 0; c < 256; ++c) {
+						if(c != p.bytes[m.src_offset + i])
+							masks_[c] &= ~bit;
+					}
+				}
+			}
+			if(len_)
+				hi_ = 1UL << (len_ - 1);
+			// with as many mismatches as fixed
+			// bytes anything would match
+			size_t	fixed = 0;
+			for(const auto& m : p.matches)
+				fixed += m.length;
+			if(fixed && (r_.size() > fixed))
+				r_.resize(fixed);
+		}
+
+		size_t length(void) const {
+			return len_;
+		}
+
+		size_t full_length(void) const {
+			return full_len_;
+		}
+
+		// mismatches past the first 64 bytes of
+		// the match at p, full_length() long
+		size_t tail_mismatches(const uint8_t* p) const {
+			size_t	rv = 0;
+			for(const auto& t : tail_) {
+				if(p[t.first] != t.second)
+					++rv;
+			}
+			return rv;
+		}
+
+		void reset(void) {
+			for(auto& r : r_)
+				r = 0;
+		}
+
+		// returns the mismatches of the match
+		// ending at c, or -1 if there isn't
+		ssize_t next(const uint8_t c) {
+			const uint64_t	m = masks_[c];
+			uint64_t	prev = r_[0];
+			r_[0] = ((r_[0] << 1) | 1) & m;
+			for(size_t j = 1; j < r_.size(); ++j) {
+				const uint64_t	cur = r_[j];
+				r_[j] = (((cur << 1) | 1) & m) | ((prev << 1) | 1);
+				prev = cur;
+			}
+			if(!(r_.back() & hi_))
+				return -1;
+			for(size_t j = 0; ; ++j) {
+				if(r_[j] & hi_)
+					return j;
+			}
+		}
+	};
+
+	// best first
+	bool near_less(const memory::near_match& lhs, const memory::near_match& rhs) {
+		if(lhs.mismatches != rhs.mismatches)
+			return lhs.mismatches < rhs.mismatches;
+		if(lhs.valid != rhs.valid)
+			return lhs.valid;
+		return lhs.addr < rhs.addr;
+	}
+
+	// keeps the best n (by mismatches only,
+	// valid is not known yet)
+	void near_trim(std::vector<memory::near_match>& v, const size_t n) {
+		if(v.size() <= n)
+			return;
+		std::nth_element(v.begin(), v.begin() + n, v.end(), near_less);
+		v.resize(n);
+	}
+}
+
+void memory::browser::find_near(pattern** b, pattern** e, const size_t k, const size_t max_out, const size_t n_threads, std::vector<std::vector<near_match>>& out) {
+	// regions are split so that threads
+	// get a similar amount of work
+	const size_t	CHUNK = 16*1024*1024,
+			// candidates kept before knowing
+			// whether their target is valid
+			KEEP = 64*max_out;
+	struct unit {
+		const mem_region	*r;
+		size_t			off,
+					len;
+	};
+	std::vector<unit>	units;
+	for(const auto& r : all_regions_) {
+		const size_t	sz = r.end - r.beg;
+		for(size_t off = 0; off < sz; off += CHUNK)
+			units.push_back(unit{ &r, off, std::min(CHUNK, sz - off) });
+	}
+	const size_t				n_pats = e - b;
+	std::vector<std::vector<std::vector<near_match>>>	found(std::max((size_t)1, n_threads), std::vector<std::vector<near_match>>(n_pats));
+	std::atomic<size_t>			next(0);
+	run_on(found.size(), [&](const size_t t) {
+		std::vector<bitap>	bt;
+		size_t			max_len = 0;
+		for(pattern** i = b; i < e; ++i) {
+			bt.push_back(bitap(**i, k));
+			max_len = std::max(max_len, bt.back().full_length());
+		}
+		std::vector<uint8_t>	buf;
+		for(size_t u = next++; u < units.size(); u = next++) {
+			const auto&	un = units[u];
+			// matches starting in this unit
+			// may end in the next one; region
+			// data may be partly read, hence
+			// always get the live content
+			const size_t	scan_len = std::min(un.len + max_len - 1, un.r->end - un.r->beg - un.off);
+			buf.resize(scan_len);
+			if(!direct_mem_read(un.r->beg + un.off, &buf[0], scan_len))
+				continue;
+			const uint8_t	*p = &buf[0];
+			for(size_t i = 0; i < n_pats; ++i) {
+				auto&		bi = bt[i];
+				auto&		f = found[t][i];
+				const size_t	len = bi.length(),
+						full_len = bi.full_length();
+				if(!len)
+					continue;
+				bi.reset();
+				for(size_t j = 0; j < scan_len; ++j) {
+					ssize_t	mm = bi.next(p[j]);
+					if(mm < 0 || j + 1 - len >= un.len)
+						continue;
+					const size_t	start = j + 1 - len;
+					if(full_len > len) {
+						// past the end of the region
+						if(start + full_len > scan_len)
+							continue;
+						mm += bi.tail_mismatches(p + start);
+						if((size_t)mm > k)
+							continue;
+					}
+					f.push_back(near_match{ un.r->beg + un.off + start, (size_t)mm, 0, false });
+					if(f.size() >= 2*KEEP)
+						near_trim(f, KEEP);
+				}
+			}
+		}
+	});
+	// merge, then check targets of
+	// the best ones and rank again
+	out.assign(n_pats, std::vector<near_match>());
+	for(size_t i = 0; i < n_pats; ++i) {
+		auto&	o = out[i];
+		for(const auto& f : found)
+			o.insert(o.end(), f[i].begin(), f[i].end());
+		near_trim(o, KEEP);
+		for(auto& m : o)
+			m.valid = safe_load_effective_addr_rel(m.addr, m.target) && find_region(m.target);
+		std::sort(o.begin(), o.end(), near_less);
+		if(o.size() > max_out)
+			o.resize(max_out);
+	}
+}
+
+namespace {
+	// where a value which looks like a
+	// pointer has been found
+	struct ptr_slot {
+		uint64_t	value,
+				addr;
+	};
+
+	bool slot_less(const ptr_slot& lhs, const ptr_slot& rhs) {
+		return lhs.value < rhs.value;
+	}
+}
+
+void memory::browser::find_pointer_paths(const size_t target, const std::vector<size_t>& roots, const size_t max_depth, const uint32_t max_offset, const size_t max_out, const size_t n_threads, std::vector<pointer_path>& out) {
+	const size_t	CHUNK = 16*1024*1024,
+			// nodes explored at each level (all
+			// threads), the others are dropped
+			MAX_NODES = 4*1024*1024,
+			n_th = std::max((size_t)1, n_threads);
+	// 1. reverse index of all the aligned values
+	// pointing into a region, sorted by value
+	std::vector<std::pair<uint64_t, uint64_t>>	ranges;
+	for(const auto& r : all_regions_)
+		ranges.push_back(std::make_pair(r.beg, r.end));
+	std::sort(ranges.begin(), ranges.end());
+	auto		is_ptr = [&ranges](const uint64_t v) -> bool {
+		auto	it = std::upper_bound(ranges.begin(), ranges.end(), std::make_pair(v, std::numeric_limits<uint64_t>::max()));
+		return (it != ranges.begin()) && (v < (--it)->second);
+	};
+	struct unit {
+		const mem_region	*r;
+		size_t			off,
+					len;
+	};
+	std::vector<unit>	units;
+	for(const auto& r : all_regions_) {
+		// the content we have, or the live
+		// one when not loaded from disk
+		const size_t	sz = (r.data && (r.data_sz > 0)) ? r.data_sz : (pid_ >= 0) ? r.end - r.beg : 0;
+		for(size_t off = 0; off < sz; off += CHUNK)
+			units.push_back(unit{ &r, off, std::min(CHUNK, sz - off) });
+	}
+	std::vector<std::vector<ptr_slot>>	idx(n_th);
+	std::atomic<size_t>			next(0);
+	run_on(n_th, [&](const size_t t) {
+		std::vector<uint8_t>	buf;
+		for(size_t u = next++; u < units.size(); u = next++) {
+			const auto&	un = units[u];
+			const uint8_t	*p = 0;
+			if(un.r->data && (un.r->data_sz > 0)) {
+				p = un.r->data + un.off;
+			} else {
+				buf.resize(un.len);
+				if(!direct_mem_read(un.r->beg + un.off, &buf[0], un.len))
+					continue;
+				p = &buf[0];
+			}
+			for(size_t i = 0; i + sizeof(uint64_t) <= un.len; i += sizeof(uint64_t)) {
+				uint64_t	v;
+				std::memcpy(&v, p + i, sizeof(v));
+				if(is_ptr(v))
+					idx[t].push_back(ptr_slot{ v, un.r->beg + un.off + i });
+			}
+		}
+		std::sort(idx[t].begin(), idx[t].end(), slot_less);
+	});
+	std::vector<ptr_slot>	index;
+	for(auto& i : idx) {
+		const size_t	mid = index.size();
+		index.insert(index.end(), i.begin(), i.end());
+		std::inplace_merge(index.begin(), index.begin() + mid, index.end(), slot_less);
+		std::vector<ptr_slot>().swap(i);
+	}
+	// 2. backwards from target, one level at a time;
+	// a node is an address pointed by its parent's
+	// value plus off. Addresses of earlier levels are
+	// not visited again, paths through them would only
+	// be longer (and cycles are cut)
+	struct node {
+		uint64_t	addr;
+		uint32_t	parent,
+				off;
+	};
+	std::vector<size_t>		r_sorted(roots);
+	std::sort(r_sorted.begin(), r_sorted.end());
+	std::vector<std::vector<node>>	levels(1, std::vector<node>(1, node{ target, 0, 0 }));
+	std::vector<uint64_t>		visited(1, target);
+	out.clear();
+	for(size_t d = 0; (d < max_depth) && !levels.rbegin()->empty() && (out.size() < max_out); ++d) {
+		const std::vector<node>&		cur = *levels.rbegin();
+		const size_t				BATCH = 1024;
+		std::vector<std::vector<node>>		found(n_th);
+		// shared by the threads, so that
+		// the whole level is capped
+		std::atomic<size_t>			n_found(0);
+		next = 0;
+		run_on(n_th, [&](const size_t t) {
+			auto&	f = found[t];
+			for(size_t b = next.fetch_add(BATCH); (b < cur.size()) && (n_found < MAX_NODES); b = next.fetch_add(BATCH)) {
+				for(size_t i = b; i < std::min(b + BATCH, cur.size()); ++i) {
+					const uint64_t	x = cur[i].addr,
+							lo = (x > max_offset) ? x - max_offset : 0;
+					auto		it = std::lower_bound(index.begin(), index.end(), ptr_slot{ lo, 0 }, slot_less);
+					for(; (it != index.end()) && (it->value <= x); ++it) {
+						if(std::binary_search(visited.begin(), visited.end(), it->addr))
+							continue;
+						if(n_found++ >= MAX_NODES)
+							return;
+						f.push_back(node{ it->addr, (uint32_t)i, (uint32_t)(x - it->value) });
+					}
+				}
+			}
+		});
+		if(n_found >= MAX_NODES)
+			std::cerr << "Pointer paths: level " << (d + 1) << " has more than " << MAX_NODES << " nodes, some paths are missing" << std::endl;
+		// paths end at the roots, other nodes
+		// are kept once (sorted, to be repeatable)
+		std::vector<node>	nl;
+		for(auto& f : found) {
+			for(const auto& n : f) {
+				if(!std::binary_search(r_sorted.begin(), r_sorted.end(), n.addr)) {
+					nl.push_back(n);
+					continue;
+				}
+				pointer_path	pp{ n.addr, std::vector<uint32_t>(1, n.off) };
+				uint32_t	p = n.parent;
+				for(size_t l = levels.size() - 1; l > 0; --l) {
+					pp.offsets.push_back(levels[l][p].off);
+					p = levels[l][p].parent;
+				}
+				out.push_back(pp);
+			}
+			std::vector<node>().swap(f);
+		}
+		std::sort(nl.begin(), nl.end(), [](const node& lhs, const node& rhs) -> bool {
+			if(lhs.addr != rhs.addr)
+				return lhs.addr < rhs.addr;
+			return (lhs.parent != rhs.parent) ? lhs.parent < rhs.parent : lhs.off < rhs.off;
+		});
+		nl.erase(std::unique(nl.begin(), nl.end(), [](const node& lhs, const node& rhs) { return lhs.addr == rhs.addr; }), nl.end());
+		const size_t	mid = visited.size();
+		for(const auto& n : nl)
+			visited.push_back(n.addr);
+		std::inplace_merge(visited.begin(), visited.begin() + mid, visited.end());
+		levels.push_back(std::vector<node>());
+		levels.rbegin()->swap(nl);
+	}
+	// shortest first, then smallest offsets
+	auto	sum = [](const pointer_path& p) -> uint64_t {
+		uint64_t	rv = 0;
+		for(const auto& o : p.offsets)
+			rv += o;
+		return rv;
+	};
+	std::stable_sort(out.begin(), out.end(), [&sum](const pointer_path& lhs, const pointer_path& rhs) -> bool {
+		if(lhs.offsets.size() != rhs.offsets.size())
+			return lhs.offsets.size() < rhs.offsets.size();
+		return sum(lhs) < sum(rhs);
+	});
+	if(out.size() > max_out)
+		out.resize(max_out);
+}
+
 bool memory::browser::direct_mem_read(const size_t addr, void* d, const ssize_t sz) {
 	if(-1 == pid_)
 		throw std::runtime_error("MH:W pid not set, can't use direct memory mode");
 	const struct iovec	local = { (void*)d, (size_t)sz },
 				remote = { (void*)addr, (size_t)sz };
+	stats::scope		sc(stats::READ);
 	const auto		rv = process_vm_readv(pid_, &local, 1, &remote, 1, 0);
-	if(rv != sz)
+	stats::add(stats::READ_CALLS);
+	if(rv > 0)
+		stats::add(stats::READ_BYTES, rv);
+	if(rv != sz) {
+		stats::add(stats::READ_FAILURES);
 		return false;
+	}
 	return true;
 }
 
-memory::browser::browser(const pid_t p, const bool dirty_opt, const bool lazy_alloc, const bool direct_mem) : pid_(p), dirty_opt_(dirty_opt), lazy_alloc_(lazy_alloc), direct_mem_(direct_mem) {
+void memory::browser::open_pidfd(void) {
+	if(-1 != pidfd_) {
+		close(pidfd_);
+		pidfd_ = -1;
+	}
+	// older kernels don't have pidfd_open,
+	// then we just can't track the process
+	if(pid_ >= 0)
+		pidfd_ = syscall(SYS_pidfd_open, pid_, 0);
+}
+
+bool memory::browser::verify_pattern(const pattern& p) {
+	if((p.mem_location < 0) || p.matches.empty())
+		return false;
+	const size_t		len = p.matches.rbegin()->tgt_offset + p.matches.rbegin()->length;
+	std::vector<uint8_t>	buf(len);
+	if(!direct_mem_read(p.mem_location, &buf[0], len))
+		return false;
+	for(const auto& i : p.matches) {
+		if(std::memcmp(&buf[i.tgt_offset], &p.bytes[i.src_offset], i.length))
+			return false;
+	}
+	return true;
+}
+
+memory::browser::browser(const pid_t p, const bool dirty_opt, const bool lazy_alloc, const bool direct_mem, const size_t mirror_budget) : pid_(p), pidfd_(-1), dirty_opt_(dirty_opt), lazy_alloc_(lazy_alloc), direct_mem_(direct_mem), mirror_budget_(mirror_budget), evictions_(0), use_clock_(0), maps_fd_(-1), maps_fp_(0), procmap_query_(true) {
+	// evicted buffers shouldn't
+	// linger in the pool either
+	if(mirror_budget_)
+		pool_.set_max_cached(std::min(mirror_budget_/4, (size_t)256*1024*1024));
+	open_pidfd();
 }
 
 memory::browser::~browser() {
+	if(-1 != pidfd_)
+		close(pidfd_);
+	if(-1 != maps_fd_)
+		close(maps_fd_);
+}
+
+bool memory::browser::alive(void) const {
+	if(pid_ < 0)
+		return false;
+	if(-1 == pidfd_)
+		return !kill(pid_, 0);
+	struct pollfd	pfd = { pidfd_, POLLIN, 0 };
+	return !poll(&pfd, 1, 0);
+}
+
+void memory::browser::attach(const pid_t p) {
+	all_regions_.clear();
+	if(-1 != maps_fd_) {
+		close(maps_fd_);
+		maps_fd_ = -1;
+	}
+	maps_fp_ = 0;
+	pid_ = p;
+	open_pidfd();
+}
+
+size_t memory::browser::relocate_patterns(pattern** b, pattern** e) {
+	std::vector<pattern*>	todo;
+	for(pattern** i = b; i < e; ++i) {
+		if(*i && !verify_pattern(**i))
+			todo.push_back(*i);
+	}
+	if(todo.empty())
+		return 0;
+	// the executable has been mapped
+	// somewhere else, full scan
+	snap();
+	find_patterns(&todo[0], &todo[0] + todo.size(), false);
+	if(lazy_alloc_)
+		clear();
+	stats::add(stats::RESCANS, todo.size());
+	return todo.size();
 }
 
 void memory::browser::snap(void) {
@@ -296,6 +1013,13 @@ void memory::browser::snap(void) {
 	verify_regions();
 }
 
+void memory::browser::snap_regions(void) {
+	if(pid_ < 0)
+		throw std::runtime_error((std::string("Can't snap invalid pid (" + std::to_string(pid_) + ")")).c_str());
+	snap_mem_regions(all_regions_, false);
+	verify_regions();
+}
+
 void memory::browser::update(void) {
 	// if we're in direct memory mode
 	// do not update
@@ -305,11 +1029,8 @@ void memory::browser::update(void) {
 	// usually shouldn't change much
 	// but it _does_ sometime
 	update_regions();
-	// don't execute the code
-	// in case we haven't enabled
-	// dirty_opt_
-	if(!dirty_opt_)
-		return;
+	// pages read so far are stale, the
+	// bitmaps are reset on next fetch
 	for(auto& v: all_regions_)
 		v.dirty = true;
 }
@@ -322,6 +1043,9 @@ void memory::browser::clear(void) {
 	if(-1 == pid_)
 		return;
 	all_regions_.clear();
+	// next update has to
+	// rebuild all_regions_
+	maps_fp_ = 0;
 }
 
 void memory::browser::store(const char* dir_name) {
@@ -330,7 +1054,9 @@ void memory::browser::store(const char* dir_name) {
 		if(mkdir(dir_name, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH))
 			throw std::runtime_error((std::string("Can't find nor create directory '") + dir_name + "'").c_str());
 	} else closedir(d);
-	for(const auto& v : all_regions_) {
+	for(auto& v : all_regions_) {
+		if(!v.data)
+			refresh_region(v);
 		char		f_name[256];
 		std::snprintf(f_name, 255, "%s/mem.%016lx-%016lx.bin", dir_name, v.beg, v.end);
 		std::ofstream	ostr(f_name, std::ios_base::binary);
@@ -370,7 +1096,7 @@ void memory::browser::load(const char* dir_name) {
 	std::sort(mem_files.begin(), mem_files.end(), [](const mem_data& lhs, const mem_data& rhs) -> bool { return lhs.file < rhs.file; } );
 	all_regions_.clear();
 	for(const auto& i : mem_files) {
-		all_regions_.push_back(mem_region(i.beg, i.end, i.file, true));
+		all_regions_.push_back(mem_region(i.beg, i.end, i.file, &pool_, true));
 		auto& latest_reg = *all_regions_.rbegin();
 		// load data
 		std::ifstream	istr((std::string(dir_name) + "/" + i.file).c_str(), std::ios_base::binary);
@@ -388,6 +1114,7 @@ void memory::browser::load(const char* dir_name) {
 
 namespace {
 	std::wstring from_utf8(const char* in, size_t sz) {
+		stats::scope	sc(stats::UTF8);
 		std::wstring	rv;
 		rv.resize(sz);
 		auto		conv = iconv_open("WCHAR_T", "UTF-8");
@@ -403,6 +1130,19 @@ namespace {
 	}
 }
 
+bool memory::browser::safe_read_bytes(const size_t addr, void* out, const size_t sz, const bool refresh) {
+	if(direct_mem_)
+		return direct_mem_read(addr, out, sz);
+	mem_region	*v = find_region(addr);
+	if(!v || (addr + sz > v->end))
+		return false;
+	v->last_used = ++use_clock_;
+	if(!fetch(*v, addr - v->beg, sz, refresh))
+		return false;
+	std::memcpy(out, &v->data[addr - v->beg], sz);
+	return true;
+}
+
 bool memory::browser::safe_read_utf8(const size_t addr, const size_t len, std::wstring& out, const bool refresh) {
 	// if we're in direct mode, reserve a buffer and read it
 	if(direct_mem_) {
@@ -416,18 +1156,17 @@ bool memory::browser::safe_read_utf8(const size_t addr, const size_t len, std::w
 	// actually correctly formatted
 	// addr between boundaries is _not_
 	// supported
-	for(auto& v : all_regions_) {
-		if(v.beg > addr || v.end <= addr)
-			continue;
-		if(refresh)
-			refresh_region(v);
-		if(addr + len > (v.data_sz + v.beg))
-			throw std::runtime_error("Can't interpret memory, T size too large");
-		const char*	utf8_ptr = (const char*)&v.data[addr - v.beg];
-		out = from_utf8(utf8_ptr, len);
-		return true;
-	}
-	return false;
+	mem_region	*v = find_region(addr);
+	if(!v)
+		return false;
+	v->last_used = ++use_clock_;
+	if(addr + len > v->end)
+		throw std::runtime_error("Can't interpret memory, T size too large");
+	if(!fetch(*v, addr - v->beg, len, refresh))
+		return false;
+	const char*	utf8_ptr = (const char*)&v->data[addr - v->beg];
+	out = from_utf8(utf8_ptr, len);
+	return true;
 }
 
 bool memory::browser::safe_load_effective_addr_rel(const size_t addr, size_t& out, const bool refresh) {
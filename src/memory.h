@@ -22,7 +22,9 @@
 #include <vector>
 #include <cstdint>
 #include <ostream>
+#include <sys/uio.h>
 #include "patterns.h"
+#include "bufpool.h"
 
 namespace memory {
 	struct pattern {
@@ -41,9 +43,31 @@ namespace memory {
 		void print(std::ostream& ostr);
 	};
 
+	// an approximate match, see browser::find_near
+	struct near_match {
+		size_t	addr,
+			mismatches,
+			// RIP relative target of the
+			// instruction at addr
+			target;
+		// target is mapped
+		bool	valid;
+	};
+
+	// offsets to follow from root to get to an
+	// address, see load_multilevel_addr_rel
+	struct pointer_path {
+		size_t			root;
+		std::vector<uint32_t>	offsets;
+	};
+
 	class browser {
 		typedef const uint8_t*	pbyte;
 
+		// regions are read in pages
+		static const size_t	PG_SHIFT = 12,
+					PG_SIZE = 1 << PG_SHIFT;
+
 		struct mem_region {
 			uint64_t	beg,
 					end;
@@ -51,14 +75,24 @@ namespace memory {
 			uint8_t		*data;
 			ssize_t		data_sz;
 			bool		dirty;
-
-			mem_region(uint64_t b, uint64_t e, const std::string& d, const bool alloc_mem) : 
-				beg(b), end(e), debug_info(d), data((alloc_mem) ? (uint8_t*)std::malloc(e-b) : 0), data_sz(e-b), dirty(true) {
-				if(alloc_mem && !data)
-					throw std::runtime_error((std::string("Can't allocate mem_region (") + std::to_string(b) + "," + std::to_string(e) + ")").c_str());
+			buffer_pool	*pool;
+			// value of use_clock_ when
+			// last read, for eviction
+			uint64_t	last_used;
+			// one bit per page of data, set once
+			// read; reset when dirty is found set
+			std::vector<uint64_t>	valid;
+			// maps_fp_ when found by query_region,
+			// 0 when it comes from /proc/<pid>/maps
+			uint64_t	query_fp;
+
+			mem_region(uint64_t b, uint64_t e, const std::string& d, buffer_pool* p, const bool alloc_mem) : 
+				beg(b), end(e), debug_info(d), data(0), data_sz(e-b), dirty(true), pool(p), last_used(0), query_fp(0) {
+				if(alloc_mem)
+					alloc();
 			}
 
-			mem_region(mem_region&& rhs) : beg(std::move(rhs.beg)), end(std::move(rhs.end)), debug_info(std::move(rhs.debug_info)), data(std::move(rhs.data)), data_sz(std::move(rhs.data_sz)), dirty(std::move(rhs.dirty))  {
+			mem_region(mem_region&& rhs) : beg(std::move(rhs.beg)), end(std::move(rhs.end)), debug_info(std::move(rhs.debug_info)), data(std::move(rhs.data)), data_sz(std::move(rhs.data_sz)), dirty(std::move(rhs.dirty)), pool(rhs.pool), last_used(rhs.last_used), valid(std::move(rhs.valid)), query_fp(rhs.query_fp)  {
 				rhs.data = 0;
 			}
 
@@ -67,30 +101,100 @@ namespace memory {
 
 			mem_region& operator=(mem_region&& rhs) {
 				if(&rhs != this) {
+					release();
 					beg = std::move(rhs.beg);
 					end = std::move(rhs.end);
 					debug_info = std::move(rhs.debug_info);
-					if(data) std::free(data);
 					data = std::move(rhs.data);
 					rhs.data = 0;
 					data_sz = std::move(rhs.data_sz);
 					dirty = std::move(rhs.dirty);
+					pool = rhs.pool;
+					last_used = rhs.last_used;
+					valid = std::move(rhs.valid);
+					query_fp = rhs.query_fp;
 				}
 				return *this;
 			}
 
+			// buffers come from and go back to
+			// the pool, their size is always
+			// the full region
+			void alloc(void) {
+				if(data)
+					return;
+				data = pool->get(end-beg);
+				valid.assign((((end-beg) >> PG_SHIFT) + 64)/64, 0);
+				dirty = true;
+			}
+
+			bool page_valid(const size_t p) const {
+				return valid[p >> 6] & (1UL << (p & 63));
+			}
+
+			void set_page(const size_t p, const bool v) {
+				if(v)
+					valid[p >> 6] |= (1UL << (p & 63));
+				else
+					valid[p >> 6] &= ~(1UL << (p & 63));
+			}
+
+			void release(void) {
+				if(!data)
+					return;
+				pool->put(data, end-beg);
+				data = 0;
+			}
 
 			~mem_region() {
-				if(data)
-					std::free(data);
+				release();
 			}
 		};
 
+		// a line of /proc/<pid>/maps we're
+		// interested in, line is an offset
+		// into maps_buf_
+		struct map_entry {
+			uint64_t	beg,
+					end;
+			size_t		line,
+					line_len;
+		};
+
 		pid_t			pid_;
+		// -1 when pidfd_open isn't
+		// supported or pid_ is not set
+		int			pidfd_;
 		bool			dirty_opt_,
 					lazy_alloc_,
 					direct_mem_;
-		std::vector<mem_region>	all_regions_;
+		// has to outlive the regions
+		buffer_pool		pool_;
+		// max bytes of mirrored regions, 0
+		// means no limit; when exceeded the
+		// least recently read are dropped
+		size_t			mirror_budget_,
+					evictions_;
+		uint64_t		use_clock_;
+		// to read missing pages
+		std::vector<struct iovec>	iov_local_,
+						iov_remote_;
+		std::vector<mem_region>	all_regions_,
+					tmp_regions_;
+		// /proc/<pid>/maps is kept open and
+		// read into the same buffer every time,
+		// maps_fp_ is the fingerprint of its
+		// content when all_regions_ was built
+		int			maps_fd_;
+		std::vector<char>	maps_buf_;
+		std::vector<map_entry>	maps_entries_;
+		uint64_t		maps_fp_;
+		bool			procmap_query_;
+		// pages query_region didn't find since
+		// the last update_regions, sorted
+		std::vector<size_t>	query_misses_;
+
+		bool read_maps(void);
 
 		void snap_mem_regions(std::vector<mem_region>& mr, const bool alloc_mem);
 
@@ -102,18 +206,45 @@ namespace memory {
 
 		void verify_regions(void);
 
+		// reads the whole region, then sets
+		// data_sz to what could be read
 		void refresh_region(mem_region& r);
 
+		// makes sure the pages spanning [off, off+len)
+		// have been read since last update(); adjacent
+		// missing pages are read together, and with
+		// refresh and no dirty_opt all are read again
+		bool fetch(mem_region& r, const size_t off, const size_t len, const bool refresh);
+
+		// evicts regions other than r until
+		// r fits into mirror_budget_
+		void make_room(const mem_region& r);
+
 		ssize_t find_first(const pattern& p, const bool debug_all, const size_t start_addr = 0);
 
 		bool direct_mem_read(const size_t addr, void* d, const ssize_t sz);
+
+		void open_pidfd(void);
+
+		bool verify_pattern(const pattern& p);
+
+		// returns the region containing addr, if
+		// not found asks the kernel directly
+		// (PROCMAP_QUERY) in case it's new
+		mem_region* find_region(const size_t addr);
+
+		mem_region* query_region(const size_t addr);
 	public:
-		browser(const pid_t p, const bool dirty_opt, const bool lazy_alloc, const bool direct_mem);
+		browser(const pid_t p, const bool dirty_opt, const bool lazy_alloc, const bool direct_mem, const size_t mirror_budget = 0);
 
 		~browser();
 
 		void snap(void);
 
+		// only the list of regions, their content
+		// isn't read (i.e. before find_near)
+		void snap_regions(void);
+
 		void update(void);
 
 		void clear(void);
@@ -128,6 +259,52 @@ namespace memory {
 			}
 		}
 
+		pid_t pid(void) const {
+			return pid_;
+		}
+
+		// best max_out locations of each pattern in [b, e)
+		// with at most k mismatching bytes (wildcards always
+		// match), into out; ranked by mismatches and then by
+		// a valid target. Regions are scanned on n_threads
+		void find_near(pattern** b, pattern** e, const size_t k, const size_t max_out, const size_t n_threads, std::vector<std::vector<near_match>>& out);
+
+		// up to max_out shortest paths from any of roots to
+		// target, with at most max_depth levels each with an
+		// offset up to max_offset, into out; uses the region
+		// content (snap or load) or reads it when missing
+		void find_pointer_paths(const size_t target, const std::vector<size_t>& roots, const size_t max_depth, const uint32_t max_offset, const size_t max_out, const size_t n_threads, std::vector<pointer_path>& out);
+
+		// becomes readable when the process exits
+		int pidfd(void) const {
+			return pidfd_;
+		}
+
+		bool alive(void) const;
+
+		const buffer_pool::stats& pool_stats(void) const {
+			return pool_.get_stats();
+		}
+
+		// bytes currently held by mirrored regions
+		size_t resident(void) const {
+			return pool_.get_stats().in_use;
+		}
+
+		size_t evictions(void) const {
+			return evictions_;
+		}
+
+		// follow a new instance of the process, all the
+		// memory content of the previous one is dropped
+		void attach(const pid_t p);
+
+		// checks the patterns are still at their
+		// previous location (i.e. after attach)
+		// and only scans for the ones which are not;
+		// returns the number of patterns scanned for
+		size_t relocate_patterns(pattern** b, pattern** e);
+
 		template<typename T>
 		bool safe_read_mem(const size_t addr, T& out, const bool refresh = false) {
 			// if we're in direct mode, go for it
@@ -138,19 +315,19 @@ namespace memory {
 			// actually correctly formatted
 			// addr between boundaries is _not_
 			// supported
-			for(auto& v : all_regions_) {
-				if(v.beg > addr || v.end <= addr)
-					continue;
-				if(refresh)
-					refresh_region(v);
-				if(addr + sizeof(T) > (v.data_sz + v.beg))
-					return false;
-				out = *(T*)&v.data[addr - v.beg];
-				return true;
-			}
-			return false;
+			mem_region	*v = find_region(addr);
+			if(!v)
+				return false;
+			v->last_used = ++use_clock_;
+			if(!fetch(*v, addr - v->beg, sizeof(T), refresh))
+				return false;
+			out = *(T*)&v->data[addr - v->beg];
+			return true;
 		}
 
+		// same as safe_read_mem, sz known at runtime
+		bool safe_read_bytes(const size_t addr, void* out, const size_t sz, const bool refresh = false);
+
 		bool safe_read_utf8(const size_t addr, const size_t len, std::wstring& out, const bool refresh = false);
 
 		bool safe_load_effective_addr_rel(const size_t addr, size_t& out, const bool refresh = false);
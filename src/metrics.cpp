@@ -0,0 +1,234 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "metrics.h"
+#include "stats.h"
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <ctime>
+#include <unistd.h>
+
+namespace {
+	// requests are not parsed, any
+	// request gets all the metrics
+	const size_t	MAX_REQUEST = 8192;
+
+	struct counter_info {
+		stats::counter	c;
+		const char	*name,
+				*type,
+				*help;
+	};
+
+	const counter_info	COUNTERS[] = {
+		{ stats::READ_CALLS, "linux_hunter_reads_total", "counter", "process_vm_readv calls" },
+		{ stats::READ_BYTES, "linux_hunter_read_bytes_total", "counter", "Bytes read from MH:W" },
+		{ stats::READ_FAILURES, "linux_hunter_read_failures_total", "counter", "Failed or short reads" },
+		{ stats::MAPS_READS, "linux_hunter_maps_reads_total", "counter", "Reads of /proc/<pid>/maps" },
+		{ stats::BUF_MMAPS, "linux_hunter_buffer_mmaps_total", "counter", "Buffers mapped for mirrored regions" },
+		{ stats::RESCANS, "linux_hunter_rescans_total", "counter", "Patterns scanned for again" },
+		{ stats::EVICTIONS, "linux_hunter_evictions_total", "counter", "Mirrored regions evicted (see --mirror-budget)" },
+		{ stats::TERM_BYTES, "linux_hunter_terminal_bytes_total", "counter", "Bytes written by the ANSI display" },
+		{ stats::MIRROR_BYTES, "linux_hunter_mirror_bytes", "gauge", "Bytes held by mirrored regions" },
+	};
+
+	static_assert(sizeof(COUNTERS)/sizeof(COUNTERS[0]) == stats::N_COUNTERS, "metrics for stats::counter missing");
+
+	double tv_secs(const struct timeval& tv) {
+		return 1.0*tv.tv_sec + 1.0e-6*tv.tv_usec;
+	}
+
+	uint64_t now_ms(void) {
+		struct timespec	ts = {0};
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec*1000UL + ts.tv_nsec/1000000UL;
+	}
+}
+
+// edge triggered, we always
+// read/write until EAGAIN
+const uint32_t	metrics::server::EVENTS = EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET;
+
+metrics::server::server(const char* path, writer w) : path_(path), fd_(-1), w_(w) {
+	struct sockaddr_un	addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(path_.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error((std::string("Metrics socket path too long '") + path_ + "'").c_str());
+	std::strcpy(addr.sun_path, path_.c_str());
+	// a previous instance may have left
+	// it behind, but only remove sockets
+	struct stat	st;
+	if(!stat(path_.c_str(), &st) && S_ISSOCK(st.st_mode))
+		unlink(path_.c_str());
+	fd_ = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if(-1 == fd_)
+		throw std::runtime_error((std::string("Can't create metrics socket: ") + strerror(errno)).c_str());
+	if(bind(fd_, (const struct sockaddr*)&addr, sizeof(addr)) || listen(fd_, 8)) {
+		const int	err = errno;
+		close(fd_);
+		throw std::runtime_error((std::string("Can't listen on metrics socket '") + path_ + "': " + strerror(err)).c_str());
+	}
+}
+
+metrics::server::~server() {
+	for(const auto& c : clients_)
+		close(c.first);
+	close(fd_);
+	unlink(path_.c_str());
+}
+
+bool metrics::server::flush(client& c, const int cfd) {
+	while(c.sent < c.out.size()) {
+		const ssize_t	wb = send(cfd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL|MSG_DONTWAIT);
+		if(wb < 0) {
+			if(EINTR == errno)
+				continue;
+			// the rest is sent on EPOLLOUT
+			return EAGAIN == errno || EWOULDBLOCK == errno;
+		}
+		c.sent += wb;
+		c.deadline_ms = now_ms() + IDLE_MS;
+	}
+	return false;
+}
+
+int metrics::server::accept(void) {
+	const int	cfd = accept4(fd_, 0, 0, SOCK_NONBLOCK|SOCK_CLOEXEC);
+	if(-1 == cfd)
+		return -1;
+	if(clients_.size() >= MAX_CLIENTS) {
+		close(cfd);
+		return -1;
+	}
+	client&	c = clients_[cfd];
+	c.req.clear();
+	c.out.clear();
+	c.sent = 0;
+	c.deadline_ms = now_ms() + IDLE_MS;
+	return cfd;
+}
+
+bool metrics::server::serve(const int cfd) {
+	auto	it = clients_.find(cfd);
+	if(it == clients_.end())
+		return false;
+	client&	c = it->second;
+	// response already under way
+	if(!c.out.empty())
+		return flush(c, cfd);
+	char	buf[1024];
+	while(true) {
+		const ssize_t	rb = read(cfd, buf, sizeof(buf));
+		if(rb < 0) {
+			if(EINTR == errno)
+				continue;
+			if(EAGAIN == errno || EWOULDBLOCK == errno)
+				break;
+			return false;
+		}
+		if(!rb)
+			return false;
+		c.req.append(buf, rb);
+		c.deadline_ms = now_ms() + IDLE_MS;
+		if(c.req.size() > MAX_REQUEST)
+			return false;
+	}
+	// wait for the full request
+	if(std::string::npos == c.req.find("\r\n\r\n") && std::string::npos == c.req.find("\n\n"))
+		return true;
+	std::string	body;
+	w_(body);
+	c.out = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+	return flush(c, cfd);
+}
+
+void metrics::server::drop(const int cfd) {
+	if(clients_.erase(cfd))
+		close(cfd);
+}
+
+void metrics::server::reap(std::vector<int>& idle) const {
+	const uint64_t	now = now_ms();
+	for(const auto& c : clients_) {
+		if(now >= c.second.deadline_ms)
+			idle.push_back(c.first);
+	}
+}
+
+void metrics::header(std::string& out, const char* name, const char* type, const char* help) {
+	out += "# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += "\n# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += '\n';
+}
+
+void metrics::sample(std::string& out, const char* name, const char* labels, const double v) {
+	char	buf[64];
+	std::snprintf(buf, sizeof(buf), " %.17g\n", v);
+	out += name;
+	if(labels) {
+		out += '{';
+		out += labels;
+		out += '}';
+	}
+	out += buf;
+}
+
+void metrics::write_stats(std::string& out) {
+	for(const auto& c : COUNTERS) {
+		header(out, c.name, c.type, c.help);
+		sample(out, c.name, 0, stats::get(c.c));
+	}
+	// histograms are only filled
+	// when stats are enabled
+	header(out, "linux_hunter_stage_seconds", "summary", "Time spent in each stage");
+	for(int i = 0; i < stats::N_STAGES; ++i) {
+		const auto&		h = stats::get((stats::stage)i);
+		const std::string	st = std::string("stage=\"") + stats::name((stats::stage)i) + "\"";
+		sample(out, "linux_hunter_stage_seconds", (st + ",quantile=\"0.5\"").c_str(), h.percentile(0.5)/1e9);
+		sample(out, "linux_hunter_stage_seconds", (st + ",quantile=\"0.99\"").c_str(), h.percentile(0.99)/1e9);
+		sample(out, "linux_hunter_stage_seconds_sum", st.c_str(), h.sum()/1e9);
+		sample(out, "linux_hunter_stage_seconds_count", st.c_str(), h.count());
+	}
+	header(out, "linux_hunter_stage_max_seconds", "gauge", "Longest time spent in each stage");
+	for(int i = 0; i < stats::N_STAGES; ++i)
+		sample(out, "linux_hunter_stage_max_seconds", (std::string("stage=\"") + stats::name((stats::stage)i) + "\"").c_str(), stats::get((stats::stage)i).max()/1e9);
+	struct rusage	ru;
+	if(!getrusage(RUSAGE_SELF, &ru)) {
+		header(out, "process_cpu_seconds_total", "counter", "Total user and system CPU time spent in seconds");
+		sample(out, "process_cpu_seconds_total", 0, tv_secs(ru.ru_utime) + tv_secs(ru.ru_stime));
+		header(out, "linux_hunter_cpu_seconds_total", "counter", "CPU time by mode");
+		sample(out, "linux_hunter_cpu_seconds_total", "mode=\"user\"", tv_secs(ru.ru_utime));
+		sample(out, "linux_hunter_cpu_seconds_total", "mode=\"system\"", tv_secs(ru.ru_stime));
+		header(out, "process_max_resident_memory_bytes", "gauge", "Peak resident memory in bytes");
+		sample(out, "process_max_resident_memory_bytes", 0, ru.ru_maxrss*1024.0);
+	}
+}
@@ -0,0 +1,101 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// Prometheus text exposition format served over
+// a unix domain socket, one response per connection
+// (i.e. curl --unix-socket p http://localhost/metrics);
+// all the fds are non blocking and meant to be driven
+// by an events::reactor. At most MAX_CLIENTS are
+// served at once, and the ones idle for longer than
+// IDLE_MS are dropped through reap
+
+namespace metrics {
+	class server {
+	public:
+		// appends all the metrics to out
+		typedef std::function<void(std::string& out)>	writer;
+	private:
+		struct client {
+			// request received so far, then
+			// the response being sent
+			std::string	req,
+					out;
+			size_t		sent;
+			uint64_t	deadline_ms;
+		};
+
+		const std::string			path_;
+		int					fd_;
+		writer					w_;
+		std::unordered_map<int, client>		clients_;
+
+		// writes as much as possible of the
+		// response, false once done or failed
+		bool flush(client& c, const int cfd);
+
+		server(const server&) = delete;
+		server& operator=(const server&) = delete;
+	public:
+		static const size_t	MAX_CLIENTS = 16;
+		static const uint64_t	IDLE_MS = 5000;
+		// client fds have to be
+		// registered with these
+		static const uint32_t	EVENTS;
+
+		server(const char* path, writer w);
+
+		~server();
+
+		int fd(void) const {
+			return fd_;
+		}
+
+		// when fd() is readable, returns the
+		// new client fd or -1; past MAX_CLIENTS
+		// new clients are closed right away
+		int accept(void);
+
+		// on any event of a client fd, returns
+		// false once the client is done; then
+		// it has to be dropped
+		bool serve(const int cfd);
+
+		void drop(const int cfd);
+
+		// appends to idle the clients past
+		// IDLE_MS, these have to be dropped
+		void reap(std::vector<int>& idle) const;
+	};
+
+	extern void header(std::string& out, const char* name, const char* type, const char* help);
+
+	extern void sample(std::string& out, const char* name, const char* labels, const double v);
+
+	// stats module and process CPU time
+	extern void write_stats(std::string& out);
+}
+
+#endif //_METRICS_H_
@@ -1,10 +1,14 @@
 #include "mhw_lookup.h"
 #include "mhw_lookup_monster.h"
 #include "offsets.h"
+#include "trace.h"
 #include <regex>
 #include <algorithm>
 #include <cwchar>
 #include <cmath> 
+#include <cstring>
+#include <chrono>
+#include <iterator>
 
 namespace {
 	bool sort_MONSTERS(void) {
@@ -52,50 +56,62 @@ namespace {
 	}
 	
 	// get session info 
-	bool get_data_session(const memory::pattern* player, memory::browser& mb, ui::mhw_data& d) {
-		const auto	pnameptr = mb.load_effective_addr_rel(player->mem_location, true);
+	bool get_data_session(const mhw_lookup::pattern_data& pd, memory::browser& mb, ui::mhw_data& d) {
+		trace::scope	ts("get_data_session");
+		const auto	pnameptr = mb.load_effective_addr_rel(pd.player->mem_location, true);
 		const auto	pnameaddr = mb.read_mem<uint32_t>(pnameptr, true);
 		// get session name (this should be UTF-8)...
-		d.session_id = mb.read_utf8(pnameaddr + offsets::PlayerNameCollection::SessionID, offsets::PlayerNameCollection::IDLength, true);
-		d.host_name = mb.read_utf8(pnameaddr + offsets::PlayerNameCollection::SessionHostPlayerName, offsets::PlayerNameCollection::PlayerNameLength, true);
+		d.session_id = mb.read_utf8(pnameaddr + pd.offs->session_id, offsets::PlayerNameCollection::IDLength, true);
+		d.host_name = mb.read_utf8(pnameaddr + pd.offs->session_host_player_name, offsets::PlayerNameCollection::PlayerNameLength, true);
 		return true;
 	}
 
 	// try to understand if the player is in hunt
 	bool get_data_ishunt(const memory::pattern* lobby, memory::browser& mb) {
+		trace::scope	ts("get_data_ishunt");
 		// in case we can't resolve lobby, return true
 		if(!lobby || (lobby->mem_location == -1))
 			return true;
 		const auto	plobbyptr = mb.load_effective_addr_rel(lobby->mem_location, true);
 		const auto	lobbyaddr = mb.read_mem<size_t>(plobbyptr, true);
-		const bool	is_mission = mb.read_mem<uint32_t>(lobbyaddr + 0x54, true) != 0,
-				is_expedition = mb.read_mem<uint32_t>(lobbyaddr + 0x38, true) != 1;
-		return is_mission || is_expedition;
+		typedef offsets::LobbyStatus	ls;
+		uint32_t	expedition = 1,
+				mission = 0;
+		if(!schema::read_struct<ls, ls::Expedition, ls::Mission>(mb, lobbyaddr, true, expedition, mission))
+			return true;
+		return (mission != 0) || (expedition != 1);
 	}
 
 	// try get players' damage (need name too)
 	bool get_data_damage(const mhw_lookup::pattern_data& pd, memory::browser& mb, ui::mhw_data& d) {
+		trace::scope	ts("get_data_damage");
 		const auto	pnameptr = mb.load_effective_addr_rel(pd.player->mem_location, true);
 		const auto	pnameaddr = mb.read_mem<uint32_t>(pnameptr, true);
 		const auto	pdmgroot = mb.load_effective_addr_rel(pd.damage->mem_location, true);
-		const uint32_t	pdmgml[] = { offsets::PlayerDamageCollection::FirstPlayerPtr + (offsets::PlayerDamageCollection::MaxPlayerCount * sizeof(size_t) * offsets::PlayerDamageCollection::NextPlayerPtr ) };
+		const auto&	o = *pd.offs;
+		const uint32_t	pdmgml[] = { o.first_player_ptr + (uint32_t)(offsets::PlayerDamageCollection::MaxPlayerCount * sizeof(size_t) * o.next_player_ptr) };
 		const auto	pdmglistaddr = mb.load_multilevel_addr_rel(pdmgroot, &pdmgml[0], &pdmgml[1], true);
 		if(!pdmglistaddr)
 			return false;
 		// for each player...
 		for(uint32_t i = 0; i < offsets::PlayerDamageCollection::MaxPlayerCount; ++i) {
-			// not sure why, but on Linux the offset has 1 more byte for each entry...
-			const auto	pnameoffset = offsets::PlayerNameCollection::PlayerNameLength * i + i*1;
-			d.players[i].name = mb.read_utf8(pnameaddr + offsets::PlayerNameCollection::FirstPlayerName + pnameoffset, offsets::PlayerNameCollection::PlayerNameLength, true);
+			// see offsets::PlayerNameCollection::PlayerNameStride
+			const auto	pnameoffset = o.player_name_stride * i;
+			d.players[i].name = mb.read_utf8(pnameaddr + o.first_player_name + pnameoffset, offsets::PlayerNameCollection::PlayerNameLength, true);
 			// a player slot is used if the string is non empty and
 			// it is not made up all of '\0's...
 			d.players[i].used = (!d.players[i].name.empty()) && (d.players[i].name.find_first_not_of(L'\0') != std::wstring::npos); 
-			if(!d.players[i].used)
+			if(!d.players[i].used) {
+				// data is kept across ticks, hence
+				// reset what a previous player left
+				d.players[i].damage = 0;
+				d.players[i].left_session = false;
 				continue;
-			const auto	pfirstplayer = pdmglistaddr + offsets::PlayerDamageCollection::FirstPlayerPtr;
-			const auto	pcurplayer = pfirstplayer + offsets::PlayerDamageCollection::NextPlayerPtr * i;
+			}
+			const auto	pfirstplayer = pdmglistaddr + o.first_player_ptr;
+			const auto	pcurplayer = pfirstplayer + o.next_player_ptr * i;
 			const auto	curplayeraddr = mb.read_mem<size_t>(pcurplayer, true);
-			d.players[i].damage = mb.read_mem<int32_t>(curplayeraddr + offsets::PlayerDamageCollection::Damage, true);
+			d.players[i].damage = mb.read_mem<int32_t>(curplayeraddr + o.player_damage, true);
 			// usually MH:W IB just overwrites the first wchar_t of
 			// the utf8 string with '\0' when a player leaves, which
 			// gives us the chance to ascertain if a player has left
@@ -108,13 +124,19 @@ namespace {
 	}
 
 	// try get a single monster's data
-	bool get_data_single_monster(const size_t maddr, memory::browser& mb, ui::mhw_data::monster_info& m) {
-		const auto	realmaddr = maddr + offsets::Monster::MonsterStartOfStructOffset + offsets::Monster::MonsterHealthComponentOffset;
-		size_t		hcompaddr = 0;
-		if(!mb.safe_read_mem<size_t>(maddr + offsets::Monster::MonsterHealthComponentOffset, hcompaddr, true))
+	bool get_data_single_monster(const gamedb::offsets_table& o, const size_t maddr, memory::browser& mb, ui::mhw_data::monster_info& m, size_t& hcompaddr) {
+		typedef offsets::Monster		mo;
+		typedef offsets::MonsterHealthComponent	mhc;
+		const auto	realmaddr = maddr + o.monster_start_of_struct + mo::HealthComponentPtr::offset;
+		float		scale_modifier = 0.0;
+		if(!schema::read_struct_at<mo, mo::HealthComponentPtr, mo::MonsterScaleModifier>(mb, maddr, true, { o.monster_health_component, o.monster_scale_modifier }, hcompaddr, scale_modifier))
+			return false;
+		const auto	id = mb.read_utf8(realmaddr + o.monster_model_id, offsets::MonsterModel::IdLength, true);
+		uint32_t	numid = 0;
+		float		size_scale = 0.0;
+		if(!schema::read_struct_at<mo, mo::MonsterNumID>(mb, maddr, true, { o.monster_num_id }, numid) ||
+		   !schema::read_struct_at<mo, mo::MonsterSizeScale>(mb, maddr, true, { o.monster_size_scale }, size_scale))
 			return false;
-		const auto	id = mb.read_utf8(realmaddr + offsets::MonsterModel::IdOffset + 0x0c, offsets::MonsterModel::IdLength, true);
-		const auto	numid = mb.read_mem<uint32_t>(maddr + offsets::Monster::MonsterNumIDOffset, true);
 		// according to SmartHunter/HunterPie, we need to split the id string
 		// by '\' and the last sub-string the the real monster Id
 		const auto	slash_p = id.find_last_of(L"\\");
@@ -125,11 +147,12 @@ namespace {
 		const std::wregex IncludeMonsterIdRegex(L"em[0-9].*");
 		if(!std::regex_match(realid, IncludeMonsterIdRegex))
 			return false;
+		// the slot may hold another monster from a
+		// previous tick, don't keep any of its data
+		m = ui::mhw_data::monster_info();
+		if(!schema::read_struct_at<mhc, mhc::MaxHealth, mhc::CurrentHealth>(mb, hcompaddr, true, { o.max_health, o.current_health }, m.hp_total, m.hp_current))
+			return false;
 		m.used = true;
-		m.hp_total = mb.read_mem<float>(hcompaddr + offsets::MonsterHealthComponent::MaxHealth, true);
-		m.hp_current = mb.read_mem<float>(hcompaddr + offsets::MonsterHealthComponent::CurrentHealth, true);
-		const auto size_scale = mb.read_mem<float>(maddr + offsets::Monster::MonsterSizeScale, true);
-		auto scale_modifier = mb.read_mem<float>(maddr + offsets::Monster::MonsterScaleModifier, true);
 		if(scale_modifier <= 0 || scale_modifier >= 2 ) scale_modifier = 1;
 		// if with SmartHunter we should do the lookup based on the
 		// string id, with info gotten from HunterPie, it's better
@@ -159,23 +182,24 @@ namespace {
 	// Seems to rely less on initial offset, which is harder to
 	// maintain on Linux - rely more on jumping through pointers
 	// which should be easier to maintain on Linux
-	bool get_data_monster(const memory::pattern* monster, memory::browser& mb, ui::mhw_data& d) {
-		const auto	mrootptr = mb.load_effective_addr_rel(monster->mem_location, true);
-		const uint32_t	mlistlookup[] = { 0x698, 0x0, 0x138, 0x0 };
+	bool get_data_monster(const mhw_lookup::pattern_data& pd, memory::browser& mb, ui::mhw_data& d, size_t (&hcomps)[3]) {
+		trace::scope	ts("get_data_monster");
+		const auto&	o = *pd.offs;
+		const auto	mrootptr = mb.load_effective_addr_rel(pd.monster->mem_location, true);
 		size_t		monsters[3] = { 0 };
-		if(!mb.safe_load_multilevel_addr_rel(mrootptr, &mlistlookup[0], &mlistlookup[4], monsters[2], true))
+		if(!mb.safe_load_multilevel_addr_rel(mrootptr, std::begin(o.monster_list), std::end(o.monster_list), monsters[2], true))
 			return false;
 		// second monster
-		if(!mb.safe_read_mem<size_t>(monsters[2] - 0x30, monsters[1], true)) {
+		if(!mb.safe_read_mem<size_t>(monsters[2] - o.second_monster, monsters[1], true)) {
 			monsters[1] = 0;
 		} else {
-			monsters[1] += offsets::Monster::MonsterStartOfStructOffset;
+			monsters[1] += o.monster_start_of_struct;
 		}
 		// first monster
-		if(!mb.safe_read_mem<size_t>(monsters[1] - offsets::Monster::MonsterStartOfStructOffset + offsets::Monster::PreviousMonsterOffset, monsters[0], true)) {
+		if(!mb.safe_read_mem<size_t>(monsters[1] - o.monster_start_of_struct + o.previous_monster, monsters[0], true)) {
 			monsters[0] = 0;
 		} else {
-			monsters[0] += offsets::Monster::MonsterStartOfStructOffset;
+			monsters[0] += o.monster_start_of_struct;
 		}
 		static_assert( sizeof(d.monsters)/sizeof(d.monsters[0]) == sizeof(monsters)/sizeof(monsters[0]), "Monsters can only be 3 at any time!");
 		uint32_t	cur_monster = 0;
@@ -184,23 +208,177 @@ namespace {
 			// memory location - this caters for 0 addresses too
 			if(monsters[i] < 0xffffff)
 				continue;
-			if(!get_data_single_monster(monsters[i], mb, d.monsters[cur_monster])) {
+			if(!get_data_single_monster(o, monsters[i], mb, d.monsters[cur_monster], hcomps[cur_monster])) {
 				d.monsters[cur_monster].used = false;
 			 } else {
 				 ++cur_monster;
 			 }
 		}
+		// reset the leftover slots, which
+		// may hold data from a previous tick
+		for(size_t i = cur_monster; i < sizeof(d.monsters)/sizeof(d.monsters[0]); ++i) {
+			d.monsters[i] = ui::mhw_data::monster_info();
+			hcomps[i] = 0;
+		}
+		return true;
+	}
+
+	// refresh only the HP of the monsters
+	// previously found by get_data_monster
+	bool get_data_monster_hp(const gamedb::offsets_table& o, memory::browser& mb, ui::mhw_data& d, const size_t (&hcomps)[3]) {
+		trace::scope	ts("get_data_monster_hp");
+		for(size_t i = 0; i < sizeof(d.monsters)/sizeof(d.monsters[0]); ++i) {
+			if(!d.monsters[i].used || !hcomps[i])
+				continue;
+			typedef offsets::MonsterHealthComponent	mhc;
+			float	hp_total = 0.0,
+				hp_current = 0.0;
+			if(!schema::read_struct_at<mhc, mhc::MaxHealth, mhc::CurrentHealth>(mb, hcomps[i], true, { o.max_health, o.current_health }, hp_total, hp_current))
+				return false;
+			d.monsters[i].hp_total = hp_total;
+			d.monsters[i].hp_current = hp_current;
+		}
 		return true;
 	}
+
+	uint64_t now_us(void) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	const char*	GROUP_NAMES[] = { "session", "hunt-status", "damage", "monster-hp", "monster-meta" };
+
+	static_assert(sizeof(GROUP_NAMES)/sizeof(GROUP_NAMES[0]) == mhw_lookup::N_GROUPS, "Data group names don't match mhw_lookup::data_group");
 }
 
-void mhw_lookup::get_data(const mhw_lookup::pattern_data& pd, memory::browser& mb, ui::mhw_data& d) {
-	d = ui::mhw_data();
-	if(!get_data_session(pd.player, mb, d))
-		return;
-	if(get_data_ishunt(pd.lobby, mb) && pd.damage)
-		get_data_damage(pd, mb, d);
-	if(pd.monster)
-		get_data_monster(pd.monster, mb, d);
+mhw_lookup::scheduler::scheduler(const size_t budget_ms) : budget_ms_(budget_ms), is_hunt_(false), hcomps_{0} {
+	// defaults: HP and damage are refreshed every
+	// tick, everything else is slow moving and
+	// can be refreshed every few seconds
+	const size_t	periods[] = { 5000, 1000, 0, 0, 2000 };
+	const int	priorities[] = { 3, 0, 1, 1, 2 };
+	for(size_t i = 0; i < N_GROUPS; ++i) {
+		auto&	g = groups_[i];
+		g.period_ms = periods[i];
+		g.priority = priorities[i];
+		g.last_us = 0;
+		g.due = true;
+		g.runs = g.skips = 0;
+		order_[i] = (data_group)i;
+	}
+	sort_order();
+}
+
+void mhw_lookup::scheduler::sort_order(void) {
+	std::stable_sort(&order_[0], &order_[N_GROUPS], [this](const data_group lhs, const data_group rhs) -> bool {
+				return groups_[lhs].priority < groups_[rhs].priority;
+			});
+}
+
+void mhw_lookup::scheduler::set_period(const data_group g, const size_t period_ms) {
+	groups_[g].period_ms = period_ms;
+}
+
+void mhw_lookup::scheduler::set_priority(const data_group g, const int priority) {
+	groups_[g].priority = priority;
+	sort_order();
+}
+
+void mhw_lookup::scheduler::set_budget(const size_t budget_ms) {
+	budget_ms_ = budget_ms;
+}
+
+void mhw_lookup::scheduler::invalidate(void) {
+	for(auto& g : groups_)
+		g.due = true;
+}
+
+void mhw_lookup::scheduler::reset(void) {
+	invalidate();
+	is_hunt_ = false;
+	for(auto& h : hcomps_)
+		h = 0;
+}
+
+const char* mhw_lookup::scheduler::group_name(const data_group g) {
+	return (g < N_GROUPS) ? GROUP_NAMES[g] : "<invalid>";
+}
+
+bool mhw_lookup::scheduler::parse_group(const char* name, data_group& g) {
+	for(size_t i = 0; i < N_GROUPS; ++i) {
+		if(!std::strcmp(name, GROUP_NAMES[i])) {
+			g = (data_group)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void mhw_lookup::get_data(const mhw_lookup::pattern_data& pd, memory::browser& mb, ui::mhw_data& d, mhw_lookup::scheduler& s) {
+	const uint64_t	tick_us = now_us();
+	// first find out which groups are due
+	for(auto& g : s.groups_) {
+		if(tick_us - g.last_us >= g.period_ms*1000)
+			g.due = true;
+	}
+	// then run them by priority, as long as
+	// we have budget left; first group always
+	// runs, so that we always make progress
+	bool	first = true;
+	for(const auto gid : s.order_) {
+		auto&	g = s.groups_[gid];
+		if(!g.due)
+			continue;
+		// damage and monsters are
+		// only relevant during a hunt
+		const bool	hunt_gated = (gid == DAMAGE) || (gid == MONSTER_HP) || (gid == MONSTER_META);
+		if(hunt_gated && !s.is_hunt_)
+			continue;
+		if(!first && s.budget_ms_ && (now_us() - tick_us >= s.budget_ms_*1000)) {
+			++g.skips;
+			continue;
+		}
+		first = false;
+		switch(gid) {
+		case SESSION:
+			get_data_session(pd, mb, d);
+			break;
+		case HUNT_STATUS: {
+			const bool	prev_hunt = s.is_hunt_;
+			s.is_hunt_ = d.hunt = get_data_ishunt(pd.lobby, mb);
+			if(!s.is_hunt_) {
+				// reset all the hunt data
+				for(auto& p : d.players)
+					p = ui::mhw_data::player_info();
+				for(auto& m : d.monsters)
+					m = ui::mhw_data::monster_info();
+				for(auto& h : s.hcomps_)
+					h = 0;
+			} else if(!prev_hunt) {
+				// hunt just started, refresh
+				// all gated groups asap
+				s.groups_[DAMAGE].due = s.groups_[MONSTER_HP].due = s.groups_[MONSTER_META].due = true;
+			}
+		} break;
+		case DAMAGE:
+			if(pd.damage)
+				get_data_damage(pd, mb, d);
+			break;
+		case MONSTER_HP:
+			// if we can't read HP, monsters
+			// may have changed, check those asap
+			if(pd.monster && !get_data_monster_hp(*pd.offs, mb, d, s.hcomps_))
+				s.groups_[MONSTER_META].due = true;
+			break;
+		case MONSTER_META:
+			if(pd.monster)
+				get_data_monster(pd, mb, d, s.hcomps_);
+			break;
+		default:
+			break;
+		}
+		g.due = false;
+		g.last_us = tick_us;
+		++g.runs;
+	}
 }
 
@@ -1,8 +1,10 @@
 #ifndef _MHW_LOOKUP_
 #define _MHW_LOOKUP_
 
+#include <atomic>
 #include "memory.h"
 #include "ui.h"
+#include "gamedb.h"
 
 namespace mhw_lookup {
 	struct pattern_data {
@@ -10,9 +12,77 @@ namespace mhw_lookup {
 					*damage,
 					*monster,
 					*lobby;
+		const	gamedb::offsets_table	*offs;
 	};
-	
-	extern void get_data(const pattern_data& pd, memory::browser& mb, ui::mhw_data& d);
+
+	// groups of fields which can be
+	// refreshed each at its own rate
+	enum data_group {
+		SESSION = 0,
+		HUNT_STATUS,
+		DAMAGE,
+		MONSTER_HP,
+		MONSTER_META,
+		N_GROUPS
+	};
+
+	// each data group has a period (0 means
+	// every tick) and a priority (lower value
+	// is higher priority); when the tick budget
+	// (0 means unlimited) is exhausted, due groups
+	// with lower priority are skipped and will be
+	// refreshed in a later tick
+	class scheduler {
+	public:
+		struct group {
+			size_t		period_ms;
+			int		priority;
+			uint64_t	last_us;
+			bool		due;
+			// read by the metrics endpoint
+			// from another thread
+			std::atomic<size_t>	runs,
+						skips;
+		};
+	private:
+		group		groups_[N_GROUPS];
+		size_t		budget_ms_;
+		data_group	order_[N_GROUPS];
+		// data cached across ticks
+		bool		is_hunt_;
+		size_t		hcomps_[3];
+
+		void sort_order(void);
+
+		friend void get_data(const pattern_data& pd, memory::browser& mb, ui::mhw_data& d, scheduler& s);
+	public:
+		scheduler(const size_t budget_ms = 0);
+
+		void set_period(const data_group g, const size_t period_ms);
+
+		void set_priority(const data_group g, const int priority);
+
+		void set_budget(const size_t budget_ms);
+
+		// force all groups to be refreshed
+		// on next tick
+		void invalidate(void);
+
+		// as above, and also drops the data
+		// cached across ticks (i.e. the process
+		// has been restarted)
+		void reset(void);
+
+		const group& get_group(const data_group g) const {
+			return groups_[g];
+		}
+
+		static const char* group_name(const data_group g);
+
+		static bool parse_group(const char* name, data_group& g);
+	};
+
+	extern void get_data(const pattern_data& pd, memory::browser& mb, ui::mhw_data& d, scheduler& s);
 }
 
 #endif //_MHW_LOOKUP_
@@ -18,6 +18,8 @@
 #ifndef _OFFSETS_H_
 #define _OFFSETS_H_
 
+#include "schema.h"
+
 /*
  * Taken from https://github.com/sir-wilhelm/SmartHunter/blob/master/SmartHunter/Game/Helpers/MhwHelper.cs
  */
@@ -31,7 +33,10 @@ namespace offsets {
 					SessionHostPlayerName = SessionID + 0x3F,
 					LobbyID = FirstPlayerName + 0x463,
 					LobbyHostPlayerName = LobbyID + 0x29,
-					NextLobbyHostName = 0x2F;
+					NextLobbyHostName = 0x2F,
+					// not sure why, but on Linux there is
+					// 1 more byte for each player name
+					PlayerNameStride = PlayerNameLength + 1;
 	}
 
 	namespace PlayerDamageCollection {
@@ -41,25 +46,50 @@ namespace offsets {
 					Damage = 0x48;
 	}
 
-	namespace Monster {
+	// structures with typed fields are
+	// read with schema::read_struct; the
+	// ones a game database can override
+	// (see gamedb::offsets_table) with
+	// schema::read_struct_at
+
+	// from the Monster AoB to the last monster
+	namespace MonsterList {
+		const static uint32_t	Chain[] = { 0x698, 0x0, 0x138, 0x0 };
+	}
+
+	struct Monster {
 		const static uint32_t	PreviousMonsterOffset = 0x10,
 					NextMonsterOffset = 0x18,
 					MonsterStartOfStructOffset = 0x40,
-					MonsterHealthComponentOffset = 0x7670,
-					MonsterNumIDOffset = 0x12280,
-					MonsterSizeScale = 0x188,
-					MonsterScaleModifier = 0x7730;
-	}
+					// before the last monster
+					SecondMonsterOffset = 0x30;
+		typedef schema::field<0x188, float>	MonsterSizeScale;
+		typedef schema::field<0x7670, uint64_t>	HealthComponentPtr;
+		typedef schema::field<0x7730, float>	MonsterScaleModifier;
+		typedef schema::field<0x12280, uint32_t>	MonsterNumID;
+		typedef schema::layout<MonsterSizeScale, HealthComponentPtr, MonsterScaleModifier, MonsterNumID>	fields;
+	};
 
 	namespace MonsterModel {
 		const static uint32_t	IdLength = 32, // 64?
-					IdOffset = 0x179;
+					IdOffset = 0x179,
+					IdStringOffset = IdOffset + 0x0c;
 	}
 
-	namespace MonsterHealthComponent {
-		const static uint32_t	MaxHealth = 0x60,
-					CurrentHealth = 0x64;
-	}
+	struct MonsterHealthComponent {
+		typedef schema::field<0x60, float>	MaxHealth;
+		typedef schema::field<0x64, float>	CurrentHealth;
+		typedef schema::layout<MaxHealth, CurrentHealth>	fields;
+	};
+
+	// quest state of the lobby
+	struct LobbyStatus {
+		// 1 when not on an expedition
+		typedef schema::field<0x38, uint32_t>	Expedition;
+		// non 0 when on a mission
+		typedef schema::field<0x54, uint32_t>	Mission;
+		typedef schema::layout<Expedition, Mission>	fields;
+	};
 }
 
 #endif //_OFFSETS_H_
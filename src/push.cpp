@@ -0,0 +1,209 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "push.h"
+#include "push_proto.h"
+#include "shmdisplay.h"
+#include <stdexcept>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+	// fields of shm_layout::data which
+	// are compared and sent on their own
+	std::vector<push_proto::field_header> make_fields(void) {
+		using namespace shm_layout;
+		std::vector<push_proto::field_header>	f;
+		auto	add = [&f](const size_t offset, const size_t size) {
+			f.push_back(push_proto::field_header{ (uint16_t)offset, (uint16_t)size });
+		};
+		add(offsetof(data, hunt), sizeof(data::hunt));
+		add(offsetof(data, ts_ms), sizeof(data::ts_ms));
+		add(offsetof(data, session_id), sizeof(data::session_id));
+		add(offsetof(data, host_name), sizeof(data::host_name));
+		for(size_t i = 0; i < N_PLAYERS; ++i) {
+			const size_t	b = offsetof(data, players) + i*sizeof(player);
+			add(b + offsetof(player, used), sizeof(player::used));
+			add(b + offsetof(player, left_session), sizeof(player::left_session));
+			add(b + offsetof(player, damage), sizeof(player::damage));
+			add(b + offsetof(player, dps_short), sizeof(player::dps_short));
+			add(b + offsetof(player, dps_long), sizeof(player::dps_long));
+			add(b + offsetof(player, dps_hunt), sizeof(player::dps_hunt));
+			add(b + offsetof(player, dps_peak), sizeof(player::dps_peak));
+			add(b + offsetof(player, name), sizeof(player::name));
+		}
+		for(size_t i = 0; i < N_MONSTERS; ++i) {
+			const size_t	b = offsetof(data, monsters) + i*sizeof(monster);
+			add(b + offsetof(monster, used), sizeof(monster::used));
+			add(b + offsetof(monster, hp_total), sizeof(monster::hp_total));
+			add(b + offsetof(monster, hp_current), sizeof(monster::hp_current));
+			add(b + offsetof(monster, body_size), sizeof(monster::body_size));
+			add(b + offsetof(monster, name), sizeof(monster::name));
+			add(b + offsetof(monster, crown), sizeof(monster::crown));
+		}
+		return f;
+	}
+
+	const std::vector<push_proto::field_header>	FIELDS = make_fields();
+
+	void append_header(std::string& out, const push_proto::msg_type t, const uint32_t len, const uint64_t version, const uint64_t base) {
+		const push_proto::header	h{ push_proto::MAGIC, (uint16_t)t, push_proto::VERSION, len, version, base };
+		out.append((const char*)&h, sizeof(h));
+	}
+
+	void append_full(std::string& out, const shm_layout::data& d, const uint64_t version) {
+		append_header(out, push_proto::FULL, sizeof(d), version, version);
+		out.append((const char*)&d, sizeof(d));
+	}
+
+	void append_delta(std::string& out, const shm_layout::data& from, const shm_layout::data& to, const uint64_t base, const uint64_t version) {
+		const size_t	mark = out.size();
+		append_header(out, push_proto::DELTA, 0, version, base);
+		const char	*f = (const char*)&from,
+				*t = (const char*)&to;
+		for(const auto& fh : FIELDS) {
+			if(!std::memcmp(f + fh.offset, t + fh.offset, fh.size))
+				continue;
+			out.append((const char*)&fh, sizeof(fh));
+			out.append(t + fh.offset, fh.size);
+		}
+		const uint32_t	len = out.size() - mark - sizeof(push_proto::header);
+		std::memcpy(&out[mark + offsetof(push_proto::header, len)], &len, sizeof(len));
+	}
+}
+
+// edge triggered, we always
+// read/write until EAGAIN
+const uint32_t	push::server::EVENTS = EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET;
+
+push::server::server(const char* path) : path_(path), fd_(-1), version_(0), prev_(), cur_() {
+	struct sockaddr_un	addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(path_.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error((std::string("Push socket path too long '") + path_ + "'").c_str());
+	std::strcpy(addr.sun_path, path_.c_str());
+	// a previous instance may have left
+	// it behind, but only remove sockets
+	struct stat	st;
+	if(!stat(path_.c_str(), &st) && S_ISSOCK(st.st_mode))
+		unlink(path_.c_str());
+	fd_ = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if(-1 == fd_)
+		throw std::runtime_error((std::string("Can't create push socket: ") + strerror(errno)).c_str());
+	if(bind(fd_, (const struct sockaddr*)&addr, sizeof(addr)) || listen(fd_, 16)) {
+		const int	err = errno;
+		close(fd_);
+		throw std::runtime_error((std::string("Can't listen on push socket '") + path_ + "': " + strerror(err)).c_str());
+	}
+}
+
+push::server::~server() {
+	for(const auto& c : clients_)
+		close(c.first);
+	close(fd_);
+	unlink(path_.c_str());
+}
+
+bool push::server::flush(client& c, const int cfd) {
+	while(true) {
+		if(c.sent == c.out.size()) {
+			c.out.clear();
+			c.sent = 0;
+			if(c.version == version_)
+				return true;
+			// all the samples missed
+			// since last time in one
+			if(c.version + 1 == version_)
+				c.out = delta_;
+			else
+				append_delta(c.out, c.last, cur_, c.version, version_);
+			c.version = version_;
+			c.last = cur_;
+		}
+		const ssize_t	wb = send(cfd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL|MSG_DONTWAIT);
+		if(wb < 0) {
+			if(EINTR == errno)
+				continue;
+			return EAGAIN == errno || EWOULDBLOCK == errno;
+		}
+		c.sent += wb;
+	}
+}
+
+int push::server::accept(void) {
+	const int	cfd = accept4(fd_, 0, 0, SOCK_NONBLOCK|SOCK_CLOEXEC);
+	if(-1 == cfd)
+		return -1;
+	client&	c = clients_[cfd];
+	c.sent = 0;
+	c.version = version_;
+	c.last = cur_;
+	append_full(c.out, cur_, version_);
+	// anything left is sent on EPOLLOUT;
+	// errors are reported to serve
+	flush(c, cfd);
+	return cfd;
+}
+
+bool push::server::serve(const int cfd) {
+	auto	it = clients_.find(cfd);
+	if(it == clients_.end())
+		return false;
+	// clients aren't supposed to
+	// send anything, just drain
+	char	buf[256];
+	while(true) {
+		const ssize_t	rb = read(cfd, buf, sizeof(buf));
+		if(rb < 0) {
+			if(EINTR == errno)
+				continue;
+			if(EAGAIN == errno || EWOULDBLOCK == errno)
+				break;
+			return false;
+		}
+		if(!rb)
+			return false;
+	}
+	return flush(it->second, cfd);
+}
+
+void push::server::drop(const int cfd) {
+	if(clients_.erase(cfd))
+		close(cfd);
+}
+
+void push::server::publish(const ui::mhw_data& d, const uint64_t ts_ms) {
+	prev_ = cur_;
+	shmdisplay::to_layout(d, ts_ms, cur_);
+	++version_;
+	delta_.clear();
+	append_delta(delta_, prev_, cur_, version_ - 1, version_);
+	// slow clients still have something queued,
+	// they catch up once that has been sent
+	for(auto& c : clients_) {
+		if(c.second.sent == c.second.out.size())
+			flush(c.second, c.first);
+	}
+}
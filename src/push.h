@@ -0,0 +1,97 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _PUSH_H_
+#define _PUSH_H_
+
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include "ui.h"
+#include "shm_layout.h"
+
+// Pushes the sampled data to any number of clients
+// over a unix domain socket (see push_proto.h): the
+// whole state on connect, then field deltas every
+// sample. Each client has its own send buffer which
+// holds at most one message; while it's not drained
+// new samples are coalesced into the next delta.
+// All the fds are non blocking and meant to be
+// driven by an events::reactor (see EVENTS)
+
+namespace push {
+	class server {
+		struct client {
+			std::string		out;
+			size_t			sent;
+			// last state queued
+			uint64_t		version;
+			shm_layout::data	last;
+		};
+
+		const std::string			path_;
+		int					fd_;
+		std::unordered_map<int, client>		clients_;
+		uint64_t				version_;
+		shm_layout::data			prev_,
+							cur_;
+		// DELTA from version_-1 to version_,
+		// shared by the clients up to date
+		std::string				delta_;
+
+		server(const server&) = delete;
+		server& operator=(const server&) = delete;
+
+		// queues what c is missing, if
+		// anything, and writes as much
+		// as possible
+		bool flush(client& c, const int cfd);
+	public:
+		// client fds have to be
+		// registered with these
+		static const uint32_t	EVENTS;
+
+		server(const char* path);
+
+		~server();
+
+		int fd(void) const {
+			return fd_;
+		}
+
+		// when fd() is readable, returns the
+		// new client fd or -1
+		int accept(void);
+
+		// on any event of a client fd, returns
+		// false once the client is gone; then
+		// it has to be dropped
+		bool serve(const int cfd);
+
+		void drop(const int cfd);
+
+		// a new sample, sent right away
+		// to the clients which can take it
+		void publish(const ui::mhw_data& d, const uint64_t ts_ms);
+
+		size_t clients(void) const {
+			return clients_.size();
+		}
+	};
+}
+
+#endif //_PUSH_H_
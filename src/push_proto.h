@@ -0,0 +1,69 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _PUSH_PROTO_H_
+#define _PUSH_PROTO_H_
+
+#include <cstdint>
+#include "shm_layout.h"
+
+// Wire format of the socket served with option
+// --push-socket; this header is meant to be used
+// by clients too
+//
+// Every message is a header followed by 'len' bytes:
+// - FULL, sent once on connect, is the whole state
+//   as a shm_layout::data at 'version'
+// - DELTA brings a client from 'base' to 'version'
+//   and is a sequence of fields, each one being
+//   a field_header followed by 'size' bytes to be
+//   copied at 'offset' into the shm_layout::data
+// 'version' grows by one every sample; a client which
+// can't keep up gets a single DELTA covering all the
+// versions it has missed ('base' is always the last
+// 'version' it has received). All the values are in
+// host byte order and nothing is aligned
+
+namespace push_proto {
+	const uint32_t	MAGIC = 0x5048484C, // 'LHHP'
+	      		VERSION = 1;
+
+	enum msg_type {
+		FULL = 1,
+		DELTA = 2
+	};
+
+#pragma pack(push, 1)
+	struct header {
+		uint32_t	magic;
+		uint16_t	type,
+				proto;
+		uint32_t	len;
+		uint64_t	version,
+				base;
+	};
+
+	struct field_header {
+		uint16_t	offset,
+				size;
+	};
+#pragma pack(pop)
+
+	static_assert(sizeof(shm_layout::data) <= UINT16_MAX, "shm_layout::data offsets don't fit field_header");
+}
+
+#endif //_PUSH_PROTO_H_
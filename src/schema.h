@@ -0,0 +1,171 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _SCHEMA_H_
+#define _SCHEMA_H_
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "memory.h"
+
+// Typed layouts of MH:W structures (see offsets.h): a
+// structure declares its fields, each with offset and
+// type, in a schema::layout named 'fields'; then
+//
+//   read_struct<S, S::A, S::B>(mb, addr, refresh, a, b)
+//
+// reads the smallest span covering A and B at once
+// and decodes both. Spans, overlaps and alignments
+// are all checked at compile time; read_struct_at
+// takes the offsets at runtime instead (i.e. from a
+// game database), these are then checked at runtime
+
+namespace schema {
+	// fields further apart than this have
+	// to be read with different calls
+	const uint32_t	MAX_SPAN = 4096;
+
+	template<uint32_t Off, typename T>
+	struct field {
+		typedef T	type;
+
+		static const uint32_t	offset = Off,
+					end = Off + sizeof(T);
+
+		static_assert(std::is_trivially_copyable<T>::value, "schema::field type has to be trivially copyable");
+		static_assert(0 == Off % alignof(T), "schema::field is misaligned");
+	};
+
+	namespace detail {
+		template<typename F, typename... R>
+		struct span {
+			static const uint32_t	beg = (F::offset < span<R...>::beg) ? F::offset : span<R...>::beg,
+						end = (F::end > span<R...>::end) ? F::end : span<R...>::end;
+		};
+
+		template<typename F>
+		struct span<F> {
+			static const uint32_t	beg = F::offset,
+						end = F::end;
+		};
+
+		template<typename F, typename... R>
+		struct disjoint : std::true_type {};
+
+		template<typename F, typename G, typename... R>
+		struct disjoint<F, G, R...> : std::integral_constant<bool, ((F::end <= G::offset) || (G::end <= F::offset)) && disjoint<F, R...>::value> {};
+
+		template<typename... F>
+		struct all_disjoint : std::true_type {};
+
+		template<typename F, typename... R>
+		struct all_disjoint<F, R...> : std::integral_constant<bool, disjoint<F, R...>::value && all_disjoint<R...>::value> {};
+
+		template<typename F, typename... L>
+		struct contains : std::false_type {};
+
+		template<typename F, typename G, typename... L>
+		struct contains<F, G, L...> : std::integral_constant<bool, std::is_same<F, G>::value || contains<F, L...>::value> {};
+
+		template<typename L, typename... F>
+		struct all_in : std::true_type {};
+
+		template<typename L, typename F, typename... R>
+		struct all_in<L, F, R...> : std::integral_constant<bool, L::template has<F>::value && all_in<L, R...>::value> {};
+
+		template<uint32_t Beg>
+		void decode(const uint8_t* p) {
+		}
+
+		template<size_t I>
+		void decode_at(const uint8_t* p, const uint32_t* offs) {
+		}
+
+		template<size_t I, typename F, typename... R>
+		void decode_at(const uint8_t* p, const uint32_t* offs, typename F::type& v, typename R::type&... r) {
+			std::memcpy(&v, p + offs[I], sizeof(v));
+			decode_at<I+1, R...>(p, offs, r...);
+		}
+
+		template<uint32_t Beg, typename F, typename... R>
+		void decode(const uint8_t* p, typename F::type& v, typename R::type&... r) {
+			std::memcpy(&v, p + (F::offset - Beg), sizeof(v));
+			decode<Beg, R...>(p, r...);
+		}
+	}
+
+	template<typename... F>
+	struct layout {
+		static_assert(detail::all_disjoint<F...>::value, "schema::layout has overlapping fields");
+
+		template<typename G>
+		struct has : detail::contains<G, F...> {};
+	};
+
+	// one read of the span covering F..., then each
+	// value is copied into out, in the same order
+	template<typename S, typename... F>
+	bool read_struct(memory::browser& mb, const size_t addr, const bool refresh, typename F::type&... out) {
+		typedef detail::span<F...>	sp;
+		static_assert(detail::all_in<typename S::fields, F...>::value, "schema::read_struct field is not part of the structure");
+		static_assert(detail::all_disjoint<F...>::value, "schema::read_struct fields overlap");
+		static_assert(sp::end - sp::beg <= MAX_SPAN, "schema::read_struct fields are too far apart to be read at once");
+		std::array<uint8_t, sp::end - sp::beg>	buf;
+		if(!mb.safe_read_mem(addr + sp::beg, buf, refresh))
+			return false;
+		detail::decode<sp::beg, F...>(buf.data(), out...);
+		return true;
+	}
+
+	// same as read_struct, offs are the offsets of F...
+	// in place of the compile time ones; false if these
+	// overlap, are misaligned or too far apart
+	template<typename S, typename... F>
+	bool read_struct_at(memory::browser& mb, const size_t addr, const bool refresh, const uint32_t (&offs)[sizeof...(F)], typename F::type&... out) {
+		static_assert(detail::all_in<typename S::fields, F...>::value, "schema::read_struct_at field is not part of the structure");
+		static_assert(detail::all_disjoint<F...>::value, "schema::read_struct_at fields overlap");
+		const uint32_t	sizes[] = { (uint32_t)sizeof(typename F::type)... },
+				aligns[] = { (uint32_t)alignof(typename F::type)... };
+		uint32_t	beg = offs[0],
+				end = offs[0] + sizes[0];
+		for(size_t i = 0; i < sizeof...(F); ++i) {
+			if(offs[i] % aligns[i])
+				return false;
+			for(size_t j = 0; j < i; ++j) {
+				if((offs[i] < offs[j] + sizes[j]) && (offs[j] < offs[i] + sizes[i]))
+					return false;
+			}
+			beg = std::min(beg, offs[i]);
+			end = std::max(end, offs[i] + sizes[i]);
+		}
+		if(end - beg > MAX_SPAN)
+			return false;
+		uint32_t	rel[sizeof...(F)];
+		for(size_t i = 0; i < sizeof...(F); ++i)
+			rel[i] = offs[i] - beg;
+		uint8_t		buf[MAX_SPAN];
+		if(!mb.safe_read_bytes(addr + beg, buf, end - beg, refresh))
+			return false;
+		detail::decode_at<0, F...>(buf, rel, out...);
+		return true;
+	}
+}
+
+#endif //_SCHEMA_H_
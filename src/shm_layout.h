@@ -0,0 +1,100 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _SHM_LAYOUT_H_
+#define _SHM_LAYOUT_H_
+
+#include <atomic>
+#include <cstdint>
+
+// Layout of the shared memory segment written with
+// option --shm-display; this header is meant to be
+// used by readers too (see shm_reader.cpp)
+//
+// There are two slots, the writer always writes the
+// one not pointed by 'gen' and then increments 'gen';
+// each slot has its own seqlock ('seq' is odd while
+// being written), hence readers can read the latest
+// slot in place and validate with 'seq' afterwards.
+// 'gen' is also a futex word, readers can wait on it
+// (FUTEX_WAIT, not private) and are always woken up;
+// readers never write, a read only mapping is enough
+
+namespace shm_layout {
+	const uint32_t	MAGIC = 0x4853484C, // 'LHSH'
+	      		VERSION = 1,
+			MAX_FRAME = 8192, // wchar_t
+			N_PLAYERS = 4,
+			N_MONSTERS = 3;
+
+	struct player {
+		uint8_t		used,
+				left_session,
+				pad[2];
+		int32_t		damage;
+		float		dps_short,
+				dps_long,
+				dps_hunt,
+				dps_peak;
+		wchar_t		name[32];
+	};
+
+	struct monster {
+		uint8_t		used,
+				pad[3];
+		float		hp_total,
+				hp_current,
+				body_size;
+		char		name[64],
+				crown[16];
+	};
+
+	struct data {
+		uint8_t		hunt,
+				pad[7];
+		uint64_t	ts_ms;
+		wchar_t		session_id[16],
+				host_name[40];
+		player		players[N_PLAYERS];
+		monster		monsters[N_MONSTERS];
+	};
+
+	struct slot {
+		std::atomic<uint32_t>	seq;
+		uint32_t		frame_len;
+		data			d;
+		// hashtext format, see hashtext_fmt.h
+		wchar_t			frame[MAX_FRAME];
+	};
+
+	struct segment {
+		uint32_t		magic,
+					version;
+		std::atomic<uint32_t>	gen;
+		uint32_t		pad;
+		slot			slots[2];
+	};
+
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "std::atomic<uint32_t> can't be used as futex word");
+
+	inline const slot& latest(const segment& s, const uint32_t gen) {
+		return s.slots[gen & 0x01];
+	}
+}
+
+#endif //_SHM_LAYOUT_H_
+
@@ -0,0 +1,128 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+// Reference reader of the shared memory segment
+// written by linux-hunter with option --shm-display
+// Usage: linux-hunter-shm-reader [-f] name
+//   prints the structured data every time a new
+//   frame is published, or the frame itself as
+//   plain text with option '-f'
+
+#include "shm_layout.h"
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <clocale>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+	void print_data(const shm_layout::data& d) {
+		std::printf("ts %lu hunt %d session [%ls] host [%ls]\n", d.ts_ms, (int)d.hunt, d.session_id, d.host_name);
+		for(const auto& p : d.players) {
+			if(!p.used)
+				continue;
+			std::printf("  %-32ls %10d %8.1f dps%s\n", p.name, p.damage, p.dps_short, (p.left_session) ? " (left)" : "");
+		}
+		for(const auto& m : d.monsters) {
+			if(!m.used)
+				continue;
+			std::printf("  %-32s %8.0f/%8.0f %s\n", m.name, m.hp_current, m.hp_total, m.crown);
+		}
+	}
+
+	// strips '#' escapes, keeps '##' as '#'
+	std::wstring from_hashtext(const wchar_t* f, const uint32_t len) {
+		std::wstring	out;
+		for(uint32_t i = 0; i < len; ++i) {
+			if((f[i] == L'#') && (i+1 < len)) {
+				++i;
+				if(f[i] == L'#')
+					out += L'#';
+				continue;
+			}
+			out += f[i];
+		}
+		return out;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const bool	frame_mode = (argc > 2) && !std::strcmp(argv[1], "-f");
+	if(argc < 2 || (argc > 2 && !frame_mode)) {
+		std::fprintf(stderr, "Usage: %s [-f] name\n", argv[0]);
+		return 1;
+	}
+	std::setlocale(LC_CTYPE, "");
+	const std::string	name = (argv[argc-1][0] == '/') ? argv[argc-1] : std::string("/") + argv[argc-1];
+	const int		fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if(-1 == fd) {
+		std::fprintf(stderr, "Can't open shared memory segment '%s': %s\n", name.c_str(), strerror(errno));
+		return 1;
+	}
+	// map once, then all reads are done in
+	// place; read only, as the segment
+	// usually belongs to root
+	void	*p = mmap(0, sizeof(shm_layout::segment), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(MAP_FAILED == p) {
+		std::fprintf(stderr, "Can't map shared memory segment\n");
+		return 1;
+	}
+	const auto&	seg = *(const shm_layout::segment*)p;
+	if((seg.magic != shm_layout::MAGIC) || (seg.version != shm_layout::VERSION)) {
+		std::fprintf(stderr, "Invalid shared memory segment\n");
+		return 1;
+	}
+	uint32_t	last_gen = 0;
+	while(true) {
+		// wait for a new generation
+		const uint32_t	gen = seg.gen.load(std::memory_order_acquire);
+		if(gen == last_gen) {
+			syscall(SYS_futex, &seg.gen, FUTEX_WAIT, gen, 0, 0, 0);
+			continue;
+		}
+		const auto&	s = shm_layout::latest(seg, gen);
+		const uint32_t	seq = s.seq.load(std::memory_order_acquire);
+		if(seq & 0x01)
+			continue;
+		// process the slot in place, then make sure
+		// it hasn't been modified meanwhile
+		shm_layout::data	d;
+		std::wstring		frame;
+		if(frame_mode)
+			frame = from_hashtext(s.frame, std::min(s.frame_len, shm_layout::MAX_FRAME));
+		else
+			d = s.d;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(s.seq.load(std::memory_order_relaxed) != seq)
+			continue;
+		last_gen = gen;
+		if(frame_mode)
+			std::printf("%ls\n", frame.c_str());
+		else
+			print_data(d);
+		std::fflush(stdout);
+	}
+}
+
@@ -0,0 +1,138 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "shmdisplay.h"
+#include "shm_layout.h"
+#include "hashtext_brush.h"
+#include <string>
+#include <cstring>
+#include <cwchar>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+	template<size_t N>
+	void copy_str(wchar_t (&out)[N], const std::wstring& in) {
+		const size_t	sz = std::min(N-1, in.size());
+		std::wmemcpy(out, in.c_str(), sz);
+		out[sz] = L'\0';
+	}
+
+	template<size_t N>
+	void copy_str(char (&out)[N], const char* in) {
+		std::strncpy(out, in, N-1);
+		out[N-1] = '\0';
+	}
+
+	class simpl : public ht_fmt::basic_brush<shmdisplay::iface> {
+		const std::string	name_;
+		int			fd_;
+		shm_layout::segment	*seg_;
+		shm_layout::data	data_;
+	public:
+		simpl(const char* name) : name_((name[0] == '/') ? name : std::string("/") + name), fd_(shm_open(name_.c_str(), O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)), seg_(0), data_() {
+			if(-1 == fd_)
+				throw std::runtime_error((std::string("Can't open shared memory segment '") + name_ + "': " + strerror(errno)).c_str());
+			if(ftruncate(fd_, sizeof(shm_layout::segment))) {
+				close(fd_);
+				shm_unlink(name_.c_str());
+				throw std::runtime_error("Can't resize shared memory segment");
+			}
+			void	*p = mmap(0, sizeof(shm_layout::segment), PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+			if(MAP_FAILED == p) {
+				close(fd_);
+				shm_unlink(name_.c_str());
+				throw std::runtime_error("Can't map shared memory segment");
+			}
+			// segment is zero filled, hence the
+			// atomics are already initialized
+			seg_ = (shm_layout::segment*)p;
+			seg_->magic = shm_layout::MAGIC;
+			seg_->version = shm_layout::VERSION;
+		}
+
+		~simpl() {
+			munmap(seg_, sizeof(shm_layout::segment));
+			close(fd_);
+			shm_unlink(name_.c_str());
+		}
+
+		virtual void set_data(const ui::mhw_data& d, const uint64_t ts_ms) {
+			shmdisplay::to_layout(d, ts_ms, data_);
+		}
+
+		virtual void display(void) {
+			const uint32_t	gen = seg_->gen.load(std::memory_order_relaxed);
+			auto&		s = seg_->slots[(gen + 1) & 0x01];
+			// seqlock write, odd means in progress
+			const uint32_t	seq = s.seq.load(std::memory_order_relaxed);
+			s.seq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			s.d = data_;
+			s.frame_len = std::min((size_t)shm_layout::MAX_FRAME, buf_.size());
+			std::wmemcpy(s.frame, buf_.data(), s.frame_len);
+			s.seq.store(seq + 2, std::memory_order_release);
+			// then publish the slot and wake up
+			// readers; readers can't write, so
+			// we don't know whether any waits,
+			// without waiters it's cheap anyway
+			seg_->gen.store(gen + 1, std::memory_order_release);
+			syscall(SYS_futex, &seg_->gen, FUTEX_WAKE, INT32_MAX, 0, 0, 0);
+		}
+	};
+}
+
+shmdisplay::iface* shmdisplay::get(const char* name) {
+	return new simpl(name);
+}
+
+void shmdisplay::to_layout(const ui::mhw_data& d, const uint64_t ts_ms, shm_layout::data& out) {
+	static_assert(shm_layout::N_PLAYERS == sizeof(d.players)/sizeof(d.players[0]), "shm_layout::N_PLAYERS doesn't match ui::mhw_data");
+	static_assert(shm_layout::N_MONSTERS == sizeof(d.monsters)/sizeof(d.monsters[0]), "shm_layout::N_MONSTERS doesn't match ui::mhw_data");
+	out.hunt = d.hunt;
+	out.ts_ms = ts_ms;
+	copy_str(out.session_id, d.session_id);
+	copy_str(out.host_name, d.host_name);
+	for(uint32_t i = 0; i < shm_layout::N_PLAYERS; ++i) {
+		const auto&	p = d.players[i];
+		auto&		o = out.players[i];
+		o.used = p.used;
+		o.left_session = p.left_session;
+		o.damage = p.damage;
+		o.dps_short = p.dps_short;
+		o.dps_long = p.dps_long;
+		o.dps_hunt = p.dps_hunt;
+		o.dps_peak = p.dps_peak;
+		copy_str(o.name, p.name);
+	}
+	for(uint32_t i = 0; i < shm_layout::N_MONSTERS; ++i) {
+		const auto&	m = d.monsters[i];
+		auto&		o = out.monsters[i];
+		o.used = m.used;
+		o.hp_total = m.hp_total;
+		o.hp_current = m.hp_current;
+		o.body_size = m.body_size;
+		copy_str(o.name, m.name);
+		copy_str(o.crown, m.crown);
+	}
+}
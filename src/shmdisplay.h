@@ -0,0 +1,45 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _SHMDISPLAY_H_
+#define _SHMDISPLAY_H_
+
+#include <cstdint>
+#include "vbrush.h"
+#include "ui.h"
+#include "shm_layout.h"
+
+namespace shmdisplay {
+	// a vbrush::iface which publishes both the frame
+	// and the data it has been drawn from, into a
+	// shared memory segment (see shm_layout.h)
+	class iface : public vbrush::iface {
+	public:
+		// to be invoked before drawing, the data is
+		// published together with the frame on display()
+		virtual void set_data(const ui::mhw_data& d, const uint64_t ts_ms) = 0;
+	};
+
+	extern iface* get(const char* name);
+
+	// fixed size copy of d, as published
+	// in the segment (and by push::server)
+	extern void to_layout(const ui::mhw_data& d, const uint64_t ts_ms, shm_layout::data& out);
+}
+
+#endif //_SHMDISPLAY_H_
+
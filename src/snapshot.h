@@ -0,0 +1,88 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <atomic>
+#include <cstdint>
+#include "timer.h"
+#include "ui.h"
+#include "grid.h"
+
+namespace snapshot {
+	// data as sampled from MH:W at a given time
+	struct mhw_sample {
+		uint64_t	seq = 0,
+				ts_ms = 0;
+		timer::cpu_ms	tm;
+		ui::mhw_data	data;
+		// data laid out for display
+		grid::frame	view;
+	};
+
+	// lock-free single producer/single consumer
+	// handoff of the latest value - this is a
+	// triple buffer, hence the producer never
+	// waits for the consumer and vice versa and
+	// T doesn't need to be trivially copyable
+	template<typename T>
+	class latest {
+		const static uint8_t	NEW_BIT = 0x04,
+		      			IDX_MASK = 0x03;
+
+		T			bufs_[3];
+		std::atomic<uint8_t>	mid_;
+		uint8_t			back_,
+					front_;
+
+		latest(const latest&) = delete;
+		latest& operator=(const latest&) = delete;
+	public:
+		latest() : mid_(1), back_(0), front_(2) {
+		}
+
+		// producer side: fill back() and
+		// then publish(); after publish()
+		// back() is a different buffer
+		T& back(void) {
+			return bufs_[back_];
+		}
+
+		void publish(void) {
+			back_ = mid_.exchange(back_ | NEW_BIT, std::memory_order_acq_rel) & IDX_MASK;
+		}
+
+		// consumer side: returns true if
+		// a new value has been published
+		// since last call, front() is then
+		// pointing to such value
+		bool update(void) {
+			if(!(mid_.load(std::memory_order_acquire) & NEW_BIT))
+				return false;
+			front_ = mid_.exchange(front_, std::memory_order_acq_rel) & IDX_MASK;
+			return true;
+		}
+
+		const T& front(void) const {
+			return bufs_[front_];
+		}
+	};
+}
+
+#endif //_SNAPSHOT_H_
+
@@ -0,0 +1,125 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "stats.h"
+#include <cstdio>
+
+namespace {
+	const char	*STAGE_NAMES[] = { "maps", "read", "utf8", "lookup", "layout", "display", "f-display", "shm-display", "tick", "tick-cpu" },
+			*COUNTER_NAMES[] = { "process_vm_readv", "bytes read", "read failures", "maps reads", "buffer mmaps", "rescans", "evictions", "terminal bytes", "mirror bytes" };
+
+	static_assert(sizeof(STAGE_NAMES)/sizeof(STAGE_NAMES[0]) == stats::N_STAGES, "stats::stage names missing");
+	static_assert(sizeof(COUNTER_NAMES)/sizeof(COUNTER_NAMES[0]) == stats::N_COUNTERS, "stats::counter names missing");
+
+	// set before threads are started
+	bool				stats_on = false;
+	stats::histogram		stages[stats::N_STAGES];
+	std::atomic<uint64_t>		counters[stats::N_COUNTERS];
+}
+
+stats::histogram::histogram() : count_(0), sum_(0), max_(0) {
+	for(auto& b : buckets_)
+		b.store(0, std::memory_order_relaxed);
+}
+
+int stats::histogram::bucket(const uint64_t v) {
+	if(v < (1 << SUB_BITS))
+		return v;
+	const int	e = 63 - __builtin_clzll(v);
+	return ((e - SUB_BITS + 1) << SUB_BITS) + ((v >> (e - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+}
+
+uint64_t stats::histogram::lower_bound(const int b) {
+	if(b < (1 << SUB_BITS))
+		return b;
+	const int	e = (b >> SUB_BITS) + SUB_BITS - 1;
+	return (uint64_t)((1 << SUB_BITS) + (b & ((1 << SUB_BITS) - 1))) << (e - SUB_BITS);
+}
+
+void stats::histogram::add(const uint64_t ns) {
+	buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(ns, std::memory_order_relaxed);
+	uint64_t	cur = max_.load(std::memory_order_relaxed);
+	while((ns > cur) && !max_.compare_exchange_weak(cur, ns, std::memory_order_relaxed));
+}
+
+uint64_t stats::histogram::percentile(const double p) const {
+	const uint64_t	n = count(),
+			target = (uint64_t)(p*n + 0.5);
+	uint64_t	cum = 0;
+	for(int i = 0; i < N_BUCKETS; ++i) {
+		cum += buckets_[i].load(std::memory_order_relaxed);
+		// report the middle of the bucket, never
+		// more than what has been recorded
+		if(cum && (cum >= target)) {
+			const uint64_t	lb = lower_bound(i),
+					ub = (i + 1 < N_BUCKETS) ? lower_bound(i + 1) : lb;
+			const uint64_t	rv = lb + (ub - lb)/2;
+			return (rv < max()) ? rv : max();
+		}
+	}
+	return max();
+}
+
+void stats::enable(void) {
+	stats_on = true;
+}
+
+bool stats::enabled(void) {
+	return stats_on;
+}
+
+void stats::record(const stage s, const uint64_t ns) {
+	stages[s].add(ns);
+}
+
+const stats::histogram& stats::get(const stage s) {
+	return stages[s];
+}
+
+void stats::add(const counter c, const uint64_t n) {
+	counters[c].fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t stats::get(const counter c) {
+	return counters[c].load(std::memory_order_relaxed);
+}
+
+const char* stats::name(const stage s) {
+	return STAGE_NAMES[s];
+}
+
+const char* stats::name(const counter c) {
+	return COUNTER_NAMES[c];
+}
+
+void stats::print(std::ostream& ostr) {
+	char	buf[128];
+	std::snprintf(buf, sizeof(buf), "%-12s%10s%10s%10s%10s", "Stage (ms)", "count", "p50", "p99", "max");
+	ostr << buf << '\n';
+	for(int i = 0; i < N_STAGES; ++i) {
+		const auto&	h = get((stage)i);
+		if(!h.count())
+			continue;
+		std::snprintf(buf, sizeof(buf), "%-12s%10lu%10.3f%10.3f%10.3f", name((stage)i), (unsigned long)h.count(), h.percentile(0.5)/1e6, h.percentile(0.99)/1e6, h.max()/1e6);
+		ostr << buf << '\n';
+	}
+	for(int i = 0; i < N_COUNTERS; ++i)
+		ostr << name((counter)i) << ": " << get((counter)i) << ((i + 1 < N_COUNTERS) ? ", " : "\n");
+	ostr << std::flush;
+}
@@ -0,0 +1,147 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <time.h>
+#include "trace.h"
+
+// Process wide instrumentation: per stage latency
+// histograms and counters, any thread can record;
+// stage timers only run once enable() is invoked
+// (see --stats), counters are always updated
+
+namespace stats {
+	enum stage {
+		MAPS = 0,	// /proc/<pid>/maps read and parse
+		READ,		// process_vm_readv
+		UTF8,		// strings conversion
+		LOOKUP,		// mhw_lookup::get_data
+		LAYOUT,		// ui::draw
+		DISPLAY,	// terminal display
+		F_DISPLAY,	// file display
+		SHM_DISPLAY,	// shared memory display
+		TICK,		// whole sampling tick
+		TICK_CPU,	// same, thread CPU time
+		N_STAGES
+	};
+
+	enum counter {
+		READ_CALLS = 0,
+		READ_BYTES,
+		READ_FAILURES,
+		MAPS_READS,
+		BUF_MMAPS,
+		RESCANS,
+		EVICTIONS,
+		TERM_BYTES,
+		MIRROR_BYTES,	// gauge: each instance adds the change
+				// of its own value (wrapping), hence
+				// this is their sum
+		N_COUNTERS
+	};
+
+	// log-linear histogram of ns values, 8 buckets
+	// per power of 2, hence values are within 12.5%
+	class histogram {
+		const static int		SUB_BITS = 3,
+		      				N_BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+		std::atomic<uint32_t>		buckets_[N_BUCKETS];
+		std::atomic<uint64_t>		count_,
+						sum_,
+						max_;
+
+		static int bucket(const uint64_t v);
+
+		static uint64_t lower_bound(const int b);
+	public:
+		histogram();
+
+		void add(const uint64_t ns);
+
+		uint64_t count(void) const {
+			return count_.load(std::memory_order_relaxed);
+		}
+
+		uint64_t sum(void) const {
+			return sum_.load(std::memory_order_relaxed);
+		}
+
+		uint64_t max(void) const {
+			return max_.load(std::memory_order_relaxed);
+		}
+
+		// p in [0, 1]
+		uint64_t percentile(const double p) const;
+	};
+
+	extern void enable(void);
+
+	extern bool enabled(void);
+
+	extern void record(const stage s, const uint64_t ns);
+
+	extern const histogram& get(const stage s);
+
+	extern void add(const counter c, const uint64_t n = 1);
+
+	extern uint64_t get(const counter c);
+
+	extern const char* name(const stage s);
+
+	extern const char* name(const counter c);
+
+	// on-exit summary
+	extern void print(std::ostream& ostr);
+
+	inline uint64_t now_ns(const clockid_t clk = CLOCK_MONOTONIC) {
+		struct timespec	ts;
+		clock_gettime(clk, &ts);
+		return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+	}
+
+	// records the time spent in the scope, also
+	// on the trace timeline (monotonic clock only)
+	class scope {
+		const stage	s_;
+		const clockid_t	clk_;
+		const uint64_t	beg_;
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+	public:
+		scope(const stage s, const clockid_t clk = CLOCK_MONOTONIC) : s_(s), clk_(clk), beg_((enabled() || ((CLOCK_MONOTONIC == clk) && trace::enabled())) ? now_ns(clk) : 0) {
+		}
+
+		~scope() {
+			if(!beg_)
+				return;
+			const uint64_t	end = now_ns(clk_);
+			if(enabled())
+				record(s_, end - beg_);
+			if((CLOCK_MONOTONIC == clk_) && trace::enabled())
+				trace::complete(name(s_), beg_, end);
+		}
+	};
+}
+
+#endif //_STATS_H_
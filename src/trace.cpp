@@ -0,0 +1,181 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "trace.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdexcept>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+	// per thread, i.e. about 1.5 MiB each; the
+	// writer drains every DRAIN_MS, hence this is
+	// only about bursts, not the session length
+	const size_t	RING_SIZE = 1 << 16,
+			DRAIN_MS = 250;
+
+	struct event {
+		const char	*name;
+		uint64_t	beg_ns,
+				end_ns;
+	};
+
+	// single producer (its thread),
+	// single consumer (the writer)
+	struct ring {
+		const pid_t		tid;
+		std::atomic<const char*>	name;
+		bool			name_written;
+		std::vector<event>	evs;
+		std::atomic<uint64_t>	head,
+					tail,
+					dropped;
+
+		ring(const pid_t t) : tid(t), name(0), name_written(false), evs(RING_SIZE), head(0), tail(0), dropped(0) {
+		}
+
+		void push(const event& e) {
+			const uint64_t	h = head.load(std::memory_order_relaxed);
+			if(h - tail.load(std::memory_order_acquire) >= RING_SIZE) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			evs[h & (RING_SIZE - 1)] = e;
+			head.store(h + 1, std::memory_order_release);
+		}
+	};
+
+	// set before threads are started
+	bool					trace_on = false;
+	FILE					*out = 0;
+	bool					first_event = true;
+	uint64_t				base_ns = 0;
+	std::mutex				rings_mtx;
+	std::vector<std::unique_ptr<ring>>	rings;
+	thread_local ring			*tl_ring = 0;
+	std::thread				writer;
+	std::mutex				writer_mtx;
+	std::condition_variable			writer_cv;
+	bool					writer_stop = false;
+
+	ring* get_ring(void) {
+		if(!tl_ring) {
+			std::lock_guard<std::mutex>	l(rings_mtx);
+			rings.push_back(std::unique_ptr<ring>(new ring(syscall(SYS_gettid))));
+			tl_ring = rings.back().get();
+		}
+		return tl_ring;
+	}
+
+	void write_sep(void) {
+		if(!first_event)
+			std::fputs(",\n", out);
+		first_event = false;
+	}
+
+	// timestamps are in usec
+	void drain(void) {
+		std::vector<ring*>	rs;
+		{
+			std::lock_guard<std::mutex>	l(rings_mtx);
+			for(auto& r : rings)
+				rs.push_back(r.get());
+		}
+		const pid_t	pid = getpid();
+		for(auto r : rs) {
+			const char	*name = r->name.load(std::memory_order_acquire);
+			if(name && !r->name_written) {
+				write_sep();
+				std::fprintf(out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", (int)pid, (int)r->tid, name);
+				r->name_written = true;
+			}
+			const uint64_t	h = r->head.load(std::memory_order_acquire);
+			uint64_t	t = r->tail.load(std::memory_order_relaxed);
+			for(; t < h; ++t) {
+				const event&	e = r->evs[t & (RING_SIZE - 1)];
+				const uint64_t	beg = e.beg_ns - base_ns,
+						dur = e.end_ns - e.beg_ns;
+				write_sep();
+				std::fprintf(out, "{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%lu.%03lu,\"dur\":%lu.%03lu}", e.name, (int)pid, (int)r->tid, (unsigned long)(beg/1000), (unsigned long)(beg%1000), (unsigned long)(dur/1000), (unsigned long)(dur%1000));
+			}
+			r->tail.store(t, std::memory_order_release);
+		}
+		std::fflush(out);
+	}
+
+	void writer_run(void) {
+		std::unique_lock<std::mutex>	l(writer_mtx);
+		while(!writer_stop) {
+			writer_cv.wait_for(l, std::chrono::milliseconds(DRAIN_MS));
+			drain();
+		}
+	}
+}
+
+void trace::start(const char* fname) {
+	out = std::fopen(fname, "w");
+	if(!out)
+		throw std::runtime_error((std::string("Can't open trace file '") + fname + "': " + strerror(errno)).c_str());
+	std::fputs("[\n", out);
+	base_ns = now_ns();
+	trace_on = true;
+	writer = std::thread(writer_run);
+}
+
+void trace::stop(void) {
+	if(!trace_on)
+		return;
+	{
+		std::lock_guard<std::mutex>	l(writer_mtx);
+		writer_stop = true;
+	}
+	writer_cv.notify_one();
+	writer.join();
+	trace_on = false;
+	// whatever is left
+	drain();
+	std::fputs("\n]\n", out);
+	std::fclose(out);
+	out = 0;
+	uint64_t	dropped = 0;
+	for(const auto& r : rings)
+		dropped += r->dropped.load();
+	if(dropped)
+		std::cerr << "Trace: " << dropped << " events dropped" << std::endl;
+}
+
+bool trace::enabled(void) {
+	return trace_on;
+}
+
+void trace::thread_name(const char* name) {
+	if(trace_on)
+		get_ring()->name.store(name, std::memory_order_release);
+}
+
+void trace::complete(const char* name, const uint64_t beg_ns, const uint64_t end_ns) {
+	get_ring()->push(event{ name, beg_ns, end_ns });
+}
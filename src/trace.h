@@ -0,0 +1,70 @@
+/*
+    This file is part of linux-hunter.
+
+    linux-hunter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linux-hunter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with linux-hunter.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <cstdint>
+#include <time.h>
+
+// Timeline of what each thread does, written as
+// Chrome/Perfetto trace-event JSON (see --trace);
+// events go into a preallocated ring per thread
+// and a background thread drains those into the
+// file, when a ring is full events are dropped
+
+namespace trace {
+	// to be invoked before any thread is started
+	extern void start(const char* fname);
+
+	// flushes all the events and closes the file,
+	// after all the other threads are done
+	extern void stop(void);
+
+	extern bool enabled(void);
+
+	// name shown for the current thread, has
+	// to be a literal (it's not copied)
+	extern void thread_name(const char* name);
+
+	// name has to be a literal too
+	extern void complete(const char* name, const uint64_t beg_ns, const uint64_t end_ns);
+
+	inline uint64_t now_ns(void) {
+		struct timespec	ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+	}
+
+	class scope {
+		const char	*name_;
+		const uint64_t	beg_;
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+	public:
+		scope(const char* name) : name_(name), beg_(enabled() ? now_ns() : 0) {
+		}
+
+		~scope() {
+			if(beg_)
+				complete(name_, beg_, now_ns());
+		}
+	};
+}
+
+#endif //_TRACE_H_
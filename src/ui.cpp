@@ -1,9 +1,47 @@
 #include "ui.h"
+#include "stats.h"
 
-extern void ui::draw(vbrush::iface* b, const size_t flags, const app_data& ad, const mhw_data& d, const bool no_color, const bool compact_display) {
+namespace {
+	// see --stats
+	void draw_stats(grid::frame* b, const bool compact_display) {
+		char	buf[256];
+		b->next_row(compact_display ? 1 : 2);
+		if(!b->same_row(grid::key()("stats"))) {
+			std::snprintf(buf, 256, "%-16s%8s%10s%10s%10s", "Stage (ms)", "Count", "p50", "p99", "Max");
+			b->set_attr_on(vbrush::iface::attr::REVERSE);
+			b->draw_text(buf);
+			b->set_attr_off(vbrush::iface::attr::REVERSE);
+		}
+		for(int i = 0; i < stats::N_STAGES; ++i) {
+			const auto&	h = stats::get((stats::stage)i);
+			if(!h.count())
+				continue;
+			b->next_row();
+			const uint64_t	p50 = h.percentile(0.5),
+					p99 = h.percentile(0.99),
+					max = h.max();
+			if(b->same_row(grid::key()(i)(h.count())(p50)(p99)(max)))
+				continue;
+			std::snprintf(buf, 256, "%-16s%8lu%10.3f%10.3f%10.3f", stats::name((stats::stage)i), (unsigned long)h.count(), p50/1e6, p99/1e6, max/1e6);
+			b->draw_text(buf);
+		}
+		b->next_row();
+		const uint64_t	calls = stats::get(stats::READ_CALLS),
+				bytes = stats::get(stats::READ_BYTES),
+				fails = stats::get(stats::READ_FAILURES),
+				mirror = stats::get(stats::MIRROR_BYTES);
+		if(!b->same_row(grid::key()(calls)(bytes)(fails)(mirror))) {
+			std::snprintf(buf, 256, "reads %lu (%.1f MiB, %lu failed) mirror %.1f MiB", (unsigned long)calls, bytes/1048576.0, (unsigned long)fails, mirror/1048576.0);
+			b->set_attr_on(vbrush::iface::attr::DIM);
+			b->draw_text(buf);
+			b->set_attr_off(vbrush::iface::attr::DIM);
+		}
+	}
+}
+
+extern void ui::draw(grid::frame* b, const size_t flags, const app_data& ad, const mhw_data& d, const bool no_color, const bool compact_display) {
 	char		buf[256]; // local buffer for strings
-	if(!b->init())
-		return;
+	b->init();
 	/*
 	24                      
 	XXXXXXXXXXXXXXXXXXXXXXXX
@@ -19,15 +57,33 @@ extern void ui::draw(vbrush::iface* b, const size_t flags, const app_data& ad, c
 	// if crown data is enabled, the total h_offset has ot be increased by 8
 	const unsigned	h_add_offset = ((flags & draw_flags::SHOW_CROWN_DATA) ? 8 : 0);
 	
+	// one tab per MH:W instance
+	if(ad.n_tabs > 1) {
+		if(!b->same_row(grid::key()(ad.tab)(ad.n_tabs)(ad.pid))) {
+			for(size_t i = 0; i < ad.n_tabs; ++i) {
+				std::snprintf(buf, 256, " %lu ", (unsigned long)i+1);
+				if(i == ad.tab)
+					b->set_attr_on(vbrush::iface::attr::REVERSE);
+				b->draw_text(buf);
+				if(i == ad.tab)
+					b->set_attr_off(vbrush::iface::attr::REVERSE);
+			}
+			std::snprintf(buf, 256, " pid %d", ad.pid);
+			b->set_attr_on(vbrush::iface::attr::DIM);
+			b->draw_text(buf);
+			b->set_attr_off(vbrush::iface::attr::DIM);
+		}
+		b->next_row();
+	}
 	if (!compact_display) {
 		// print title
-		{
+		if(!b->same_row(grid::key()(h_add_offset)(ad.version)(ad.tm.wall)(ad.tm.user)(ad.tm.system))) {
 			std::snprintf(buf, 256, "linux-hunter %-*s(%4ld/%4ld/%4ld w/u/s)", 19 + h_add_offset, ad.version, ad.tm.wall, ad.tm.user, ad.tm.system);
 			b->draw_text(buf);
-			b->next_row();
 		}
+		b->next_row();
 		// print main stats
-		{
+		if(!b->same_row(grid::key()(d.session_id)(d.host_name))) {
 			b->draw_text("SessionId:[");
 			b->set_attr_on(vbrush::iface::attr::BOLD);
 			b->draw_text(d.session_id.c_str());
@@ -37,35 +93,71 @@ extern void ui::draw(vbrush::iface* b, const size_t flags, const app_data& ad, c
 			b->draw_text(d.host_name.c_str());
 			b->set_attr_off(vbrush::iface::attr::BOLD);
 			b->draw_text("]");
-			b->next_row(2);
 		}
+		b->next_row(2);
+	}
+	if(d.waiting) {
+		if(!b->same_row(grid::key()(d.waiting))) {
+			b->set_attr_on(vbrush::iface::attr::BOLD);
+			b->draw_text("MH:W is not running, waiting for it to start again...");
+			b->set_attr_off(vbrush::iface::attr::BOLD);
+		}
+		if(flags & draw_flags::SHOW_STATS)
+			draw_stats(b, compact_display);
+		b->display();
+		return;
 	}
+	const bool	show_dps = flags & draw_flags::SHOW_DPS_DATA;
 	// print header
-	{
-		std::snprintf(buf, 256, "%-*s%-4s%-10s%-8s", 32 + h_add_offset, "Player Name", "Id", "Damage", "%");
+	if(!b->same_row(grid::key()(show_dps)(h_add_offset))) {
+		if(show_dps)
+			std::snprintf(buf, 256, "%-*s%-4s%-10s%-8s%8s%8s%8s%8s", 32 + h_add_offset, "Player Name", "Id", "Damage", "%", "DPS 5s", "30s", "Hunt", "Peak");
+		else
+			std::snprintf(buf, 256, "%-*s%-4s%-10s%-8s", 32 + h_add_offset, "Player Name", "Id", "Damage", "%");
 		b->set_attr_on(vbrush::iface::attr::REVERSE);
 		b->draw_text(buf);
 		b->set_attr_off(vbrush::iface::attr::REVERSE);
-		b->next_row();
 	}
+	b->next_row();
 	// compute total damage
 	int	total_damage = 0;
-	for(size_t i = 0; i < sizeof(d.players)/sizeof(d.players[0]); ++i)
-		total_damage += (d.players[i].used) ? d.players[i].damage : 0;
+	float	total_dps_short = 0.0,
+		total_dps_long = 0.0,
+		total_dps_hunt = 0.0;
+	for(size_t i = 0; i < sizeof(d.players)/sizeof(d.players[0]); ++i) {
+		if(!d.players[i].used)
+			continue;
+		total_damage += d.players[i].damage;
+		total_dps_short += d.players[i].dps_short;
+		total_dps_long += d.players[i].dps_long;
+		total_dps_hunt += d.players[i].dps_hunt;
+	}
 	// print players data
 	static const vbrush::iface::attr v_colors[] = { vbrush::iface::attr::C_BLUE, vbrush::iface::attr::C_MAGENTA, vbrush::iface::attr::C_YELLOW, vbrush::iface::attr::C_GREEN };
 	for(size_t i = 0; i < sizeof(d.players)/sizeof(d.players[0]); ++i) {
 		if(!d.players[i].used) {
 			// in compact mode, skip displaying empty player lines
 			if (!compact_display) {
-				std::snprintf(buf, 256, "%-*s%-4d                  ", 32 + h_add_offset, "<N/A>", (int)i);
-				b->set_attr_on(vbrush::iface::attr::DIM);
-				b->draw_text(buf);
-				b->set_attr_off(vbrush::iface::attr::DIM);
+				if(!b->same_row(grid::key()(h_add_offset)(i))) {
+					std::snprintf(buf, 256, "%-*s%-4d                  ", 32 + h_add_offset, "<N/A>", (int)i);
+					b->set_attr_on(vbrush::iface::attr::DIM);
+					b->draw_text(buf);
+					b->set_attr_off(vbrush::iface::attr::DIM);
+				}
 				b->next_row();
 			}
 			continue;
 		}
+		// the percentage depends on
+		// the total damage too
+		grid::key	k;
+		k(h_add_offset)(i)(no_color)(d.players[i].left_session)(d.players[i].name)(d.players[i].damage)(total_damage)(show_dps);
+		if(show_dps)
+			k(d.players[i].dps_short)(d.players[i].dps_long)(d.players[i].dps_hunt)(d.players[i].dps_peak);
+		if(b->same_row(k)) {
+			b->next_row();
+			continue;
+		}
 		const auto	name_attr = (d.players[i].left_session) ? vbrush::iface::attr::DIM : v_colors[i];
 		// set attribute when no_color is false
 		// OR the player has left the session
@@ -82,13 +174,20 @@ extern void ui::draw(vbrush::iface* b, const size_t flags, const app_data& ad, c
 		b->draw_text(buf);
 		std::snprintf(buf, 256, "%8.2f", (total_damage > 0) ? 100.0*d.players[i].damage/total_damage : 0);
 		b->draw_text(buf);
+		if(show_dps) {
+			std::snprintf(buf, 256, "%8.1f%8.1f%8.1f%8.1f", d.players[i].dps_short, d.players[i].dps_long, d.players[i].dps_hunt, d.players[i].dps_peak);
+			b->draw_text(buf);
+		}
 		if(d.players[i].left_session)
 			b->set_attr_off(name_attr);
         	b->next_row();
 	}
 	// now just the total
-	{
-		std::snprintf(buf, 256, "%-*s%-4s%10d%8s", 32 + h_add_offset, "Total", "", total_damage, (total_damage > 0) ? "100.00" : "0.0");
+	if(!b->same_row(grid::key()(h_add_offset)(total_damage)(show_dps)(total_dps_short)(total_dps_long)(total_dps_hunt))) {
+		if(show_dps)
+			std::snprintf(buf, 256, "%-*s%-4s%10d%8s%8.1f%8.1f%8.1f", 32 + h_add_offset, "Total", "", total_damage, (total_damage > 0) ? "100.00" : "0.0", total_dps_short, total_dps_long, total_dps_hunt);
+		else
+			std::snprintf(buf, 256, "%-*s%-4s%10d%8s", 32 + h_add_offset, "Total", "", total_damage, (total_damage > 0) ? "100.00" : "0.0");
 		b->set_attr_on(vbrush::iface::attr::BOLD);
 		b->draw_text(buf);
 		b->set_attr_off(vbrush::iface::attr::BOLD);
@@ -97,13 +196,16 @@ extern void ui::draw(vbrush::iface* b, const size_t flags, const app_data& ad, c
 	if(flags & draw_flags::SHOW_MONSTER_DATA) {
 		b->next_row(compact_display ? 1 : 2);
 		// then Monsters - first header
-		if(flags & draw_flags::SHOW_CROWN_DATA)
-			std::snprintf(buf, 256, "%-32s%-14s%-8s%-8s", "Monster Name", "HP", "%","Crown");
-		else
-			std::snprintf(buf, 256, "%-32s%-14s%-8s", "Monster Name", "HP", "%");
-		b->set_attr_on(vbrush::iface::attr::REVERSE);
-		b->draw_text(buf);
-		b->set_attr_off(vbrush::iface::attr::REVERSE);
+		const bool	show_crown = flags & draw_flags::SHOW_CROWN_DATA;
+		if(!b->same_row(grid::key()(show_crown))) {
+			if(show_crown)
+				std::snprintf(buf, 256, "%-32s%-14s%-8s%-8s", "Monster Name", "HP", "%","Crown");
+			else
+				std::snprintf(buf, 256, "%-32s%-14s%-8s", "Monster Name", "HP", "%");
+			b->set_attr_on(vbrush::iface::attr::REVERSE);
+			b->draw_text(buf);
+			b->set_attr_off(vbrush::iface::attr::REVERSE);
+		}
 		// print the monster data
 		const int	max_monsters = sizeof(d.monsters)/sizeof(d.monsters[0]);
 		int		cur_monster = 0;
@@ -114,8 +216,12 @@ extern void ui::draw(vbrush::iface* b, const size_t flags, const app_data& ad, c
 				continue;
 			}
 			b->next_row();
+			if(b->same_row(grid::key()(show_crown)(mi.name)(mi.hp_current)(mi.hp_total)(mi.crown))) {
+				++cur_monster;
+				continue;
+			}
 			if(mi.hp_current <= 0.001) b->set_attr_on(vbrush::iface::attr::DIM);
-			if(flags & draw_flags::SHOW_CROWN_DATA)
+			if(show_crown)
 				std::snprintf(buf, 256, "%-32s %6d/%6d%8.2f%8s", mi.name, (int)mi.hp_current, (int)mi.hp_total, 100.0*mi.hp_current/mi.hp_total, mi.crown);
 			else
 				std::snprintf(buf, 256, "%-32s %6d/%6d%8.2f", mi.name, (int)mi.hp_current, (int)mi.hp_total, 100.0*mi.hp_current/mi.hp_total);
@@ -124,6 +230,8 @@ extern void ui::draw(vbrush::iface* b, const size_t flags, const app_data& ad, c
 			++cur_monster;
 		}
 	}
+	if(flags & draw_flags::SHOW_STATS)
+		draw_stats(b, compact_display);
 	b->display();
 }
 
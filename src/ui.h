@@ -4,11 +4,17 @@
 #include <string>
 #include "timer.h"
 #include "vbrush.h"
+#include "grid.h"
 
 namespace ui {
 	struct app_data {
 		const char*	version;
 		timer::cpu_ms	tm;
+		// which MH:W instance this is, out
+		// of n_tabs (see --mhw-pid)
+		size_t		tab,
+				n_tabs;
+		int		pid;
 	};
 
 	struct mhw_data {
@@ -17,6 +23,11 @@ namespace ui {
 					left_session = false;
 			std::wstring	name;
 			int32_t		damage = 0;
+			// rolling damage rates, see analytics.h
+			float		dps_short = 0.0,
+					dps_long = 0.0,
+					dps_hunt = 0.0,
+					dps_peak = 0.0;
 
 		};
 
@@ -31,6 +42,10 @@ namespace ui {
 
 		std::wstring	session_id,
 				host_name;
+		bool		hunt = false;
+		// MH:W has exited, waiting
+		// for a new instance
+		bool		waiting = false;
 		player_info	players[4];
 		monster_info	monsters[3];
 	};
@@ -38,9 +53,14 @@ namespace ui {
 	enum draw_flags {
 		SHOW_MONSTER_DATA = 1,
 		SHOW_CROWN_DATA = 2,
+		SHOW_DPS_DATA = 4,
+		SHOW_STATS = 8,
 	};
 
-	extern void draw(vbrush::iface* b, const size_t flags, const app_data& ad, const mhw_data& d, const bool no_color, const bool compact_display);
+	// lays out the frame onto b, rows whose
+	// data hasn't changed are not formatted
+	// again; use grid::frame::blit to draw it
+	extern void draw(grid::frame* b, const size_t flags, const app_data& ad, const mhw_data& d, const bool no_color, const bool compact_display);
 }
 
 #endif // _UI_H_
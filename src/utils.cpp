@@ -1,31 +1,101 @@
 #include "utils.h"
 #include <dirent.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <memory>
 #include <cctype>
-#include <fstream>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+	// reads at most sz-1 bytes of a (small) file
+	// and terminates those, returns bytes read
+	ssize_t read_small_file(const char* fname, char* buf, const size_t sz) {
+		const int	fd = open(fname, O_RDONLY|O_CLOEXEC);
+		if(-1 == fd)
+			return -1;
+		const ssize_t	rb = read(fd, buf, sz-1);
+		close(fd);
+		if(rb < 0)
+			return -1;
+		buf[rb] = '\0';
+		return rb;
+	}
+}
 
 pid_t utils::find_mhw_pid(void) {
-	std::unique_ptr<DIR, void(*)(DIR*)>	d(opendir("/proc"), [](DIR *d){ if(d) closedir(d);});
-	if(!d)
-		throw std::runtime_error("Can't find MH:W pid - '/proc' doesn't seem to exist");
-	struct dirent	*de = 0;
-	while((de = readdir(d.get())) != 0) {
-		if(de->d_type != DT_DIR)
-			continue;
-		if(de->d_name[0] == '\0' || !std::isdigit(de->d_name[0]))
-			continue;
-		std::ifstream	istr((std::string("/proc/") + de->d_name + "/cmdline").c_str());
-		std::string	line;
-		if(!std::getline(istr, line))
-			continue;
-		// "Z:\\disk5\\SteamLibrary\\steamapps\\common\\Monster Hunter World\\MonsterHunterWorld.exe"
-		const static char	MHW_EXE[] = "\\MonsterHunterWorld.exe";
-		const char		*ptr_mhw = std::strstr(line.c_str(), MHW_EXE);
-		if(ptr_mhw && (ptr_mhw[23] == '\0'))
-			return std::atoi(de->d_name);
+	pid_t	rv = -1;
+	if(!try_find_mhw_pid(rv))
+		throw std::runtime_error("Can't find MH:W pid");
+	return rv;
+}
+
+bool utils::is_mhw_pid(const pid_t pid) {
+	char	fname[64],
+		buf[4096];
+	std::snprintf(fname, sizeof(fname), "/proc/%d/cmdline", (int)pid);
+	if(read_small_file(fname, buf, sizeof(buf)) <= 0)
+		return false;
+	// only the first argument, i.e.
+	// "Z:\\disk5\\SteamLibrary\\steamapps\\common\\Monster Hunter World\\MonsterHunterWorld.exe"
+	const static char	MHW_EXE[] = "\\MonsterHunterWorld.exe";
+	const char		*ptr_mhw = std::strstr(buf, MHW_EXE);
+	return ptr_mhw && (ptr_mhw[sizeof(MHW_EXE)-1] == '\0');
+}
+
+bool utils::is_mhw_comm(const char* comm) {
+	// comm is at most 15 chars, MH:W shows up either
+	// with its own truncated name or as a Wine process
+	return !std::strncmp(comm, "MonsterHunterWo", 15) || std::strstr(comm, "wine") || std::strstr(comm, "preloader");
+}
+
+namespace {
+	// invokes f on each MH:W pid until
+	// it returns false
+	template<typename F>
+	void scan_mhw_pids(F f) {
+		std::unique_ptr<DIR, void(*)(DIR*)>	d(opendir("/proc"), [](DIR *d){ if(d) closedir(d);});
+		if(!d)
+			throw std::runtime_error("Can't find MH:W pid - '/proc' doesn't seem to exist");
+		struct dirent	*de = 0;
+		while((de = readdir(d.get())) != 0) {
+			if(de->d_type != DT_DIR)
+				continue;
+			if(de->d_name[0] == '\0' || !std::isdigit(de->d_name[0]))
+				continue;
+			// comm is much smaller than cmdline,
+			// only check the latter when needed
+			const pid_t	pid = std::atoi(de->d_name);
+			char		fname[64],
+					comm[32];
+			std::snprintf(fname, sizeof(fname), "/proc/%d/comm", (int)pid);
+			if(read_small_file(fname, comm, sizeof(comm)) <= 0)
+				continue;
+			if(!utils::is_mhw_comm(comm))
+				continue;
+			if(utils::is_mhw_pid(pid) && !f(pid))
+				return;
+		}
 	}
-	throw std::runtime_error("Can't find MH:W pid");
 }
 
+bool utils::try_find_mhw_pid(pid_t& out) {
+	bool	found = false;
+	scan_mhw_pids([&](const pid_t pid) -> bool {
+		out = pid;
+		found = true;
+		return false;
+	});
+	return found;
+}
+
+size_t utils::find_mhw_pids(std::vector<pid_t>& out) {
+	out.clear();
+	scan_mhw_pids([&](const pid_t pid) -> bool {
+		out.push_back(pid);
+		return true;
+	});
+	return out.size();
+}
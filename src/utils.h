@@ -2,9 +2,25 @@
 #define _UTILS_H_
 
 #include <sys/types.h>
+#include <vector>
 
 namespace utils {
 	extern pid_t find_mhw_pid(void);
+
+	// as above, but returns false
+	// when MH:W is not running
+	extern bool try_find_mhw_pid(pid_t& out);
+
+	// all the running instances of MH:W,
+	// returns how many have been found
+	extern size_t find_mhw_pids(std::vector<pid_t>& out);
+
+	// checks the command line of pid
+	extern bool is_mhw_pid(const pid_t pid);
+
+	// cheap check on a process name (comm), true
+	// if it may be MH:W, then use is_mhw_pid
+	extern bool is_mhw_comm(const char* comm);
 }
 
 #endif //_UTILS_H_
@@ -40,6 +40,13 @@ namespace vbrush {
 		virtual void set_attr_on(const attr a) = 0;
 		virtual void set_attr_off(const attr a) = 0;
 		virtual void display(void) = 0;
+		// invoked at the beginning of a row which hasn't
+		// changed since the last display(); returns true
+		// if the row is still there and doesn't need
+		// to be drawn again
+		virtual bool keep_row(void) {
+			return false;
+		}
 		virtual ~iface() {}
 	};
 }
@@ -21,6 +21,8 @@
 #include <cwchar>
 #include <clocale>
 #include <stdexcept>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
 namespace {
 	int PLAYER_COLORS[] = { 1, 2, 3, 4 };
@@ -28,7 +30,23 @@ namespace {
 	class wimpl : public vbrush::iface {
 		WINDOW 	*w_;
 		int	cur_row_,
-			cur_col_;
+			cur_col_,
+			rows_,
+			cols_;
+		// the screen isn't cleared on every
+		// frame, each row is cleared when
+		// it's drawn again instead
+		bool	valid_,
+			full_,
+			row_ready_;
+
+		void prepare_row(void) {
+			if(row_ready_)
+				return;
+			move(cur_row_, 0);
+			clrtoeol();
+			row_ready_ = true;
+		}
 
 		int to_ncurses(const vbrush::iface::attr a) {
 			using vbrush::iface;
@@ -54,7 +72,7 @@ namespace {
 			throw std::runtime_error("Invalid vbrush::iface::attr!");
 		}
 	public:
-		wimpl() : w_(initscr()), cur_row_(0), cur_col_(0) {
+		wimpl() : w_(initscr()), cur_row_(0), cur_col_(0), rows_(0), cols_(0), valid_(false), full_(true), row_ready_(false) {
 			// this is needed for ncursesw to print out
 			// wchar_t ...
 			setlocale(LC_CTYPE, "");
@@ -73,34 +91,54 @@ namespace {
 		}
 
 		virtual bool init(void) {
-			clear();
 			cur_row_ = cur_col_ = 0;
+			row_ready_ = false;
+			// SIGWINCH is handled by the main
+			// thread, check the size ourselves
+			struct winsize	ws = {0};
+			if(!ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) && ws.ws_row && ws.ws_col && (ws.ws_row != LINES || ws.ws_col != COLS))
+				resize_term(ws.ws_row, ws.ws_col);
 			int 	row = 0, // number of terminal rows
         			col = 0; // number of terminal columns
 			getmaxyx(stdscr, row, col);      /* find the boundaries of the screeen */
+			// only clear the whole screen
+			// when we don't know what's on it
+			full_ = !valid_ || row != rows_ || col != cols_;
+			if(full_) {
+				clear();
+				rows_ = row;
+				cols_ = col;
+			}
 			// TODO check we have enough space to display
 			if(col < 64 || row < 15) {
 				mvprintw(0, 0, "Need at least a screen of 64x15 (%d/%d)", col, row);
 				refresh();
+				valid_ = false;
 				return false;
 			}
 			return true;
 		}
 
 		virtual void draw_text(const char* t, const ssize_t len) {
+			prepare_row();
 			mvprintw(cur_row_, cur_col_, "%s", t);
 			if(len >= 0) cur_col_ += len;
 			else cur_col_ += std::strlen(t);
 		}
 
 		virtual void draw_text(const wchar_t* t, const ssize_t len) {
+			prepare_row();
 			mvaddwstr(cur_row_, cur_col_, t);
 			if(len >= 0) cur_col_ += len;
 			else cur_col_ += std::wcslen(t);
 		}
 
 		virtual void next_row(const size_t n_rows) {
-			cur_row_ += n_rows;
+			for(size_t i = 0; i < n_rows; ++i) {
+				prepare_row();
+				++cur_row_;
+				row_ready_ = false;
+			}
 			cur_col_ = 0;
 		}
 
@@ -113,7 +151,22 @@ namespace {
 		}
 
 		virtual void display(void) {
+			// clear whatever was left below
+			prepare_row();
+			if(cur_row_ + 1 < rows_) {
+				move(cur_row_ + 1, 0);
+				clrtobot();
+			}
 			refresh();
+			valid_ = true;
+		}
+
+		virtual bool keep_row(void) {
+			// after clear() nothing is kept
+			if(full_)
+				return false;
+			row_ready_ = true;
+			return true;
 		}
 	};
 }